@@ -0,0 +1,275 @@
+/* etris-ansi.c -- ANSI terminal output with a shadow screen, emitting only
+ * what changed since the last flush.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "etris-ansi.h"
+
+/* A cell is its character and background, 0 for the default, or 1 plus
+ * the palette index. */
+#define E_CELL(ch, bg) ((uint32_t)((bg) + 1) << 8 | (unsigned char)(ch))
+#define E_CHAR(cell) ((char)((cell) & 0xff))
+#define E_BG(cell) ((int)((cell) >> 8) - 1)
+#define E_BLANK E_CELL(' ', ETRIS_ANSI_DEFAULT)
+
+/* shown by a terminal nothing is known about */
+#define E_UNKNOWN 0xffffffffu
+#define E_BG_UNKNOWN -2
+
+/* output is handed to the write hook in chunks of at most this */
+#define E_OUT_SIZE 4096
+
+/* longest escape sequence emitted */
+#define E_SEQ_MAX 32
+
+struct e_ansi {
+  int columns;
+  int rows;
+  uint32_t *want;
+  uint32_t *shown;
+  /* span of columns put to since last flush per row, empty if first > last */
+  short *first;
+  short *last;
+  /* cursor, x < 0 if unknown, and background currently set */
+  int x;
+  int y;
+  int bg;
+  void (*write)(const char *data, size_t n, void *context);
+  void *context;
+  size_t n;
+  char out[E_OUT_SIZE];
+};
+
+static void e_emit(ETRIS_ANSI a, const char *s, size_t n)
+{
+  if (a->n + n > sizeof(a->out)) {
+    a->write(a->out, a->n, a->context);
+    a->n = 0;
+  }
+  memcpy(a->out + a->n, s, n);
+  a->n += n;
+}
+
+/* Cursor movement by `n' in direction `d', the count left out if 1. */
+static int e_step(char *buf, int n, char d)
+{
+  return n == 1 ? sprintf(buf, "\033[%c", d) : sprintf(buf, "\033[%d%c", n, d);
+}
+
+/* Cheapest sequence moving the cursor to (x, y), stored in `buf'. */
+static int e_move(ETRIS_ANSI a, int x, int y, char *buf)
+{
+  char rel[E_SEQ_MAX], back[E_SEQ_MAX];
+  int n, m = 0, k, j;
+
+  n = sprintf(buf, "\033[%d;%dH", y + 1, x + 1);
+  if (a->x < 0)
+    return n;
+
+  if (y > a->y)
+    m += e_step(rel + m, y - a->y, 'B');
+  else if (y < a->y)
+    m += e_step(rel + m, a->y - y, 'A');
+
+  if (x > a->x)
+    m += e_step(rel + m, x - a->x, 'C');
+  else if (x < a->x) {
+    k = e_step(rel + m, a->x - x, 'D');
+    /* carriage return and forward may beat going back */
+    back[0] = '\r';
+    j = 1 + (x > 0 ? e_step(back + 1, x, 'C') : 0);
+    if (j < k) {
+      memcpy(rel + m, back, j);
+      k = j;
+    }
+    m += k;
+  }
+
+  if (m < n) {
+    memcpy(buf, rel, m);
+    return m;
+  }
+  return n;
+}
+
+/* Whether cells `from' to `to' - 1 of row `y' are known to show background
+ * `bg', so writing them again only costs their characters. */
+static int e_same_bg(ETRIS_ANSI a, int y, int from, int to, int bg)
+{
+  uint32_t *s = &a->shown[y * a->columns];
+
+  for (; from < to; from++)
+    if (s[from] == E_UNKNOWN || E_BG(s[from]) != bg)
+      return 0;
+  return 1;
+}
+
+static void e_mark_all(ETRIS_ANSI a)
+{
+  int y;
+
+  for (y = 0; y < a->rows; y++) {
+    a->first[y] = 0;
+    a->last[y] = a->columns - 1;
+  }
+}
+
+ETRIS_ANSI etris_ansi_create(int columns, int rows, 
+			     void (*func_write)(const char *data, size_t n, void *context),
+			     void *context)
+{
+  ETRIS_ANSI a;
+  int i;
+
+  if (columns < 1 || rows < 1 || columns > 0x7fff || func_write == NULL ||
+      (a = calloc(sizeof(struct e_ansi), 1)) == NULL)
+    return NULL;
+
+  a->want = malloc(columns * rows * sizeof(uint32_t));
+  a->shown = malloc(columns * rows * sizeof(uint32_t));
+  a->first = malloc(rows * sizeof(short));
+  a->last = malloc(rows * sizeof(short));
+  if (!a->want || !a->shown || !a->first || !a->last) {
+    etris_ansi_destroy(a);
+    return NULL;
+  }
+
+  a->columns = columns;
+  a->rows = rows;
+  for (i = 0; i < columns * rows; i++) {
+    a->want[i] = E_BLANK;
+    a->shown[i] = E_UNKNOWN;
+  }
+  e_mark_all(a);
+  a->x = -1;
+  a->bg = E_BG_UNKNOWN;
+  a->write = func_write;
+  a->context = context;
+
+  return a;
+}
+
+void etris_ansi_destroy(ETRIS_ANSI a)
+{
+  if (a == NULL)
+    return;
+  free(a->want);
+  free(a->shown);
+  free(a->first);
+  free(a->last);
+  free(a);
+}
+
+void etris_ansi_put(ETRIS_ANSI a, int column, int row, const char *text, int bg)
+{
+  uint32_t c;
+  int i;
+
+  if (row < 0 || row >= a->rows)
+    return;
+
+  for (; *text && column < a->columns; text++, column++) {
+    if (column < 0)
+      continue;
+    i = row * a->columns + column;
+    if (a->want[i] == (c = E_CELL(*text, bg)))
+      continue;
+    a->want[i] = c;
+    if (column < a->first[row])
+      a->first[row] = column;
+    if (column > a->last[row])
+      a->last[row] = column;
+  }
+}
+
+void etris_ansi_flush(ETRIS_ANSI a)
+{
+  char buf[E_SEQ_MAX];
+  uint32_t *want, *shown;
+  int x, y, k, bg;
+
+  for (y = 0; y < a->rows; y++) {
+    want = &a->want[y * a->columns];
+    shown = &a->shown[y * a->columns];
+
+    for (x = a->first[y]; x <= a->last[y]; x++) {
+      if (want[x] == shown[x])
+	continue;
+
+      /* write over a few unchanged cells rather than skip them */
+      if (a->y == y && a->x >= 0 && a->x < x && x - a->x <= 3 && 
+	  e_same_bg(a, y, a->x, x, a->bg)) {
+	for (; a->x < x; a->x++) {
+	  buf[0] = E_CHAR(shown[a->x]);
+	  e_emit(a, buf, 1);
+	}
+      }
+      else if (a->x != x || a->y != y) {
+	e_emit(a, buf, e_move(a, x, y, buf));
+	a->x = x;
+	a->y = y;
+      }
+
+      if ((bg = E_BG(want[x])) != a->bg) {
+	k = bg < 0 ? sprintf(buf, "\033[49m") : sprintf(buf, "\033[48;5;%dm", bg);
+	e_emit(a, buf, k);
+	a->bg = bg;
+      }
+
+      buf[0] = E_CHAR(want[x]);
+      e_emit(a, buf, 1);
+      shown[x] = want[x];
+      a->x++;
+    }
+
+    a->first[y] = a->columns;
+    a->last[y] = -1;
+  }
+
+  if (a->n > 0) {
+    a->write(a->out, a->n, a->context);
+    a->n = 0;
+  }
+}
+
+void etris_ansi_invalidate(ETRIS_ANSI a)
+{
+  int i;
+
+  e_emit(a, "\033[0m\033[2J", 8);
+  for (i = 0; i < a->columns * a->rows; i++)
+    a->shown[i] = E_BLANK;
+  e_mark_all(a);
+  a->bg = ETRIS_ANSI_DEFAULT;
+}
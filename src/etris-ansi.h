@@ -0,0 +1,108 @@
+/* etris-ansi.h -- ANSI terminal output with a shadow screen, emitting only
+ * what changed since the last flush.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ETRIS_ANSI_H
+#define __ETRIS_ANSI_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* handle to an ANSI screen */
+typedef struct e_ansi * ETRIS_ANSI;
+
+/* background of text put without a color */
+#define ETRIS_ANSI_DEFAULT -1
+
+/** 
+ * Create new screen of `columns' x `rows' character cells, placed at the 
+ * top left of the terminal, which must be larger. Output goes through 
+ * `func_write' in chunks. Nothing is assumed about what the terminal 
+ * shows, so the first flush paints every cell unless the screen is 
+ * cleared with etris_ansi_invalidate() first.
+ *
+ * @param columns Width of screen in characters
+ * @param rows Height of screen in characters
+ * @param func_write Function call hook writing `n' bytes of output
+ * @param context Passed to func_write
+ * @return Newly created screen or NULL on error
+ */
+ETRIS_ANSI etris_ansi_create(int columns, int rows, 
+			     void (*func_write)(const char *data, size_t n, void *context),
+			     void *context);
+
+/** 
+ * Destroy screen. Output not flushed is lost.
+ *
+ * @param a The screen
+ */
+void etris_ansi_destroy(ETRIS_ANSI a);
+
+/** 
+ * Put text at a position of the screen, to be shown by the next flush.
+ * Text is clipped at the right edge, control characters are not allowed.
+ * An etris block of color `c' at (x, y) is "  " put at column 2 * x of 
+ * row y with the background of `c'.
+ *
+ * @param a The screen
+ * @param column Column of first character, from 0
+ * @param row Row, from 0
+ * @param text Text to put
+ * @param bg Background as 256 color palette index or ETRIS_ANSI_DEFAULT
+ */
+void etris_ansi_put(ETRIS_ANSI a, int column, int row, const char *text, int bg);
+
+/** 
+ * Write what changed on the screen since the last flush. Cells are 
+ * compared with a shadow of what the terminal shows, unchanged cells cost
+ * nothing. The cursor is moved the shortest way there is and background
+ * colors are only set when they change.
+ *
+ * @param a The screen
+ */
+void etris_ansi_flush(ETRIS_ANSI a);
+
+/** 
+ * Clear the terminal and forget what it showed, so that the next flush
+ * paints all cells that are not blank. For new spectators and after
+ * anything else wrote to the terminal.
+ *
+ * @param a The screen
+ */
+void etris_ansi_invalidate(ETRIS_ANSI a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETRIS_ANSI_H */
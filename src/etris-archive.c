@@ -0,0 +1,432 @@
+/* etris-archive.c -- archives of recorded games with random access.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "etris.h"
+#include "etris-archive.h"
+
+#define E_MAGIC "ETRISARC"
+#define E_VERSION 1
+
+/* Everything in the file is 8 byte aligned, so it can be used in place. */
+#define E_ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+/* An archive file is the header, then for every game its log and its 
+ * keyframes, then the index with one entry per game. Numbers are stored in
+ * host byte order. */
+struct e_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t games;
+  uint64_t interval;
+  uint64_t index;
+};
+
+struct e_entry {
+  uint32_t width;
+  uint32_t height;
+  uint32_t border;
+  uint32_t sequence;
+  uint32_t seed;
+  int32_t score;
+  int32_t lines;
+  int32_t figures;
+  uint64_t ticks;
+  uint64_t log;
+  uint64_t length;
+  uint64_t keyframes;
+  uint32_t n_keyframes;
+  uint32_t snapshot_size;
+};
+
+/* Keyframe `j' of a game is its state at tick j * interval, where replay
+ * continues from. Each one is followed by the snapshot. */
+struct e_keyframe {
+  uint64_t offset;
+  uint64_t ticks;
+  uint64_t partial;
+};
+
+#define E_KEYFRAME_SIZE(snapshot) (sizeof(struct e_keyframe) + E_ALIGN8(snapshot))
+
+struct e_archive_writer {
+  FILE *f;
+  uint64_t interval;
+  uint64_t offset;
+  struct e_entry *entries;
+  uint32_t games;
+  uint32_t allocated;
+  unsigned char *keyframe;
+  size_t keyframe_size;
+  int failed;
+};
+
+struct e_archive {
+  const unsigned char *map;
+  size_t size;
+  const struct e_header *header;
+  const struct e_entry *entries;
+};
+
+/* Write to archive file, padded to 8 bytes. */
+static void e_write(ETRIS_ARCHIVE_WRITER w, const void *p, size_t n)
+{
+  static const char zeros[8];
+  size_t pad = E_ALIGN8(n) - n;
+
+  if (fwrite(p, 1, n, w->f) != n || fwrite(zeros, 1, pad, w->f) != pad)
+    w->failed = 1;
+  w->offset += n + pad;
+}
+
+/* Start game the way archived games start. */
+static ETRIS e_start(const struct etris_archive_game *game)
+{
+  ETRIS e;
+
+  if ((e = etris_create(game->width, game->height, game->border, NULL, NULL)) == NULL)
+    return NULL;
+  etris_set_sequence(e, game->sequence, game->seed);
+  etris_reset(e);
+
+  return e;
+}
+
+/* Fill in game from index entry. */
+static void e_game(const struct e_entry *entry, struct etris_archive_game *game)
+{
+  game->width = entry->width;
+  game->height = entry->height;
+  game->border = entry->border;
+  game->sequence = entry->sequence;
+  game->seed = entry->seed;
+  game->score = entry->score;
+  game->lines = entry->lines;
+  game->figures = entry->figures;
+  game->ticks = (unsigned long)entry->ticks;
+}
+
+ETRIS_ARCHIVE_WRITER etris_archive_create(const char *path, unsigned long interval)
+{
+  struct e_header header;
+  ETRIS_ARCHIVE_WRITER w;
+
+  if (interval < 1 || (w = calloc(1, sizeof(struct e_archive_writer))) == NULL)
+    return NULL;
+
+  if ((w->f = fopen(path, "wb")) == NULL) {
+    free(w);
+    return NULL;
+  }
+  w->interval = interval;
+
+  /* left invalid until the index is written */
+  memset(&header, 0, sizeof(header));
+  e_write(w, &header, sizeof(header));
+
+  return w;
+}
+
+int etris_archive_add(ETRIS_ARCHIVE_WRITER w, struct etris_archive_game *game, 
+		      const unsigned char *log, size_t length)
+{
+  struct etris_replay_pos pos = {0, 0, 0};
+  struct e_keyframe k;
+  struct e_entry *entry;
+  size_t size;
+  void *p;
+  ETRIS e;
+  int rc;
+
+  if (w->games == w->allocated) {
+    if ((p = realloc(w->entries, (w->allocated * 2 + 64) * sizeof(struct e_entry))) == NULL)
+      return ETRIS_ERR_NOMEM;
+    w->entries = p;
+    w->allocated = w->allocated * 2 + 64;
+  }
+
+  if ((e = e_start(game)) == NULL)
+    return ETRIS_ERR;
+
+  size = E_KEYFRAME_SIZE(etris_snapshot_size(e));
+  if (size > w->keyframe_size) {
+    if ((p = realloc(w->keyframe, size)) == NULL) {
+      etris_destroy(e);
+      return ETRIS_ERR_NOMEM;
+    }
+    w->keyframe = p;
+    w->keyframe_size = size;
+  }
+
+  entry = &w->entries[w->games];
+  memset(entry, 0, sizeof(struct e_entry));
+  entry->log = w->offset;
+  entry->length = length;
+  e_write(w, log, length);
+
+  entry->keyframes = w->offset;
+  entry->snapshot_size = etris_snapshot_size(e);
+  do {
+    k.offset = pos.offset;
+    k.ticks = pos.ticks;
+    k.partial = pos.partial;
+    memcpy(w->keyframe, &k, sizeof(k));
+    etris_snapshot(e, w->keyframe + sizeof(k));
+    e_write(w, w->keyframe, sizeof(k) + entry->snapshot_size);
+    entry->n_keyframes++;
+
+    rc = etris_replay_to(e, log, length, &pos, pos.ticks + w->interval);
+  } while (rc != ETRIS_ERR && pos.offset < length);
+
+  if (rc == ETRIS_ERR || w->failed) {
+    /* drop what was written of the game */
+    w->offset = entry->log;
+    w->failed = fseeko(w->f, (off_t)w->offset, SEEK_SET) != 0;
+    etris_destroy(e);
+    return ETRIS_ERR;
+  }
+
+  etris_score(e, &game->score, &game->lines, &game->figures);
+  game->ticks = pos.ticks;
+  etris_destroy(e);
+
+  entry->width = game->width;
+  entry->height = game->height;
+  entry->border = game->border;
+  entry->sequence = game->sequence;
+  entry->seed = game->seed;
+  entry->score = game->score;
+  entry->lines = game->lines;
+  entry->figures = game->figures;
+  entry->ticks = game->ticks;
+  w->games++;
+
+  return ETRIS_OK;
+}
+
+int etris_archive_finish(ETRIS_ARCHIVE_WRITER w)
+{
+  struct e_header header;
+  int failed;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, E_MAGIC, sizeof(header.magic));
+  header.version = E_VERSION;
+  header.games = w->games;
+  header.interval = w->interval;
+  header.index = w->offset;
+
+  e_write(w, w->entries, w->games * sizeof(struct e_entry));
+  if (fseeko(w->f, 0, SEEK_SET) != 0)
+    w->failed = 1;
+  e_write(w, &header, sizeof(header));
+
+  failed = (fclose(w->f) != 0) || w->failed;
+  free(w->keyframe);
+  free(w->entries);
+  free(w);
+
+  return failed ? ETRIS_ERR : ETRIS_OK;
+}
+
+ETRIS_ARCHIVE etris_archive_open(const char *path)
+{
+  const struct e_entry *entry;
+  ETRIS_ARCHIVE a;
+  struct stat st;
+  void *map;
+  uint32_t g;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct e_header) || 
+      (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+
+  if ((a = malloc(sizeof(struct e_archive))) == NULL) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  a->map = map;
+  a->size = st.st_size;
+  a->header = map;
+  a->entries = (const struct e_entry *)(a->map + a->header->index);
+
+  if (memcmp(a->header->magic, E_MAGIC, sizeof(a->header->magic)) != 0 || 
+      a->header->version != E_VERSION || a->header->interval < 1 ||
+      a->header->index > a->size || a->header->index % 8 != 0 ||
+      (a->size - a->header->index) / sizeof(struct e_entry) < a->header->games) {
+    etris_archive_close(a);
+    return NULL;
+  }
+
+  for (g = 0; g < a->header->games; g++) {
+    entry = &a->entries[g];
+    if (entry->log > a->size || entry->length > a->size - entry->log ||
+	entry->n_keyframes < 1 || entry->keyframes > a->size || 
+	(a->size - entry->keyframes) / E_KEYFRAME_SIZE(entry->snapshot_size) < entry->n_keyframes) {
+      etris_archive_close(a);
+      return NULL;
+    }
+  }
+
+  /* games are looked at here and there, reading ahead does not pay */
+  posix_madvise(map, st.st_size, POSIX_MADV_RANDOM);
+
+  return a;
+}
+
+void etris_archive_close(ETRIS_ARCHIVE a)
+{
+  munmap((void *)a->map, a->size);
+  free(a);
+}
+
+int etris_archive_games(ETRIS_ARCHIVE a)
+{
+  return a->header->games;
+}
+
+int etris_archive_game(ETRIS_ARCHIVE a, int g, struct etris_archive_game *game, 
+		       const unsigned char **log, size_t *length)
+{
+  if (g < 0 || (uint32_t)g >= a->header->games)
+    return ETRIS_ERR;
+
+  if (game)
+    e_game(&a->entries[g], game);
+  if (log)
+    *log = a->map + a->entries[g].log;
+  if (length)
+    *length = a->entries[g].length;
+
+  return ETRIS_OK;
+}
+
+int etris_archive_seek(ETRIS_ARCHIVE a, int g, unsigned long tick, ETRIS e)
+{
+  const struct e_entry *entry;
+  const unsigned char *k;
+  struct etris_replay_pos pos;
+  struct e_keyframe kf;
+  uint64_t j;
+  int width, height, border;
+
+  if (g < 0 || (uint32_t)g >= a->header->games)
+    return ETRIS_ERR;
+
+  entry = &a->entries[g];
+  etris_dimensions(e, &width, &height, &border);
+  if (width != (int)entry->width || height != (int)entry->height || 
+      border != (int)entry->border || etris_snapshot_size(e) != entry->snapshot_size)
+    return ETRIS_ERR;
+
+  if ((j = tick / a->header->interval) >= entry->n_keyframes)
+    j = entry->n_keyframes - 1;
+  k = a->map + entry->keyframes + j * E_KEYFRAME_SIZE(entry->snapshot_size);
+
+  /* the file may be corrupt or crafted, keyframes are checked as restored */
+  memcpy(&kf, k, sizeof(kf));
+  if (kf.offset > entry->length || etris_restore_checked(e, k + sizeof(kf)) != ETRIS_OK)
+    return ETRIS_ERR;
+  pos.offset = kf.offset;
+  pos.ticks = kf.ticks;
+  pos.partial = kf.partial;
+
+  return etris_replay_to(e, a->map + entry->log, entry->length, &pos, tick);
+}
+
+int etris_archive_verify(ETRIS_ARCHIVE a, int g)
+{
+  struct etris_archive_game game;
+  struct etris_replay_pos pos = {0, 0, 0};
+  const struct e_entry *entry;
+  const unsigned char *log, *k;
+  struct e_keyframe kf;
+  unsigned char *snapshot;
+  int score, lines, figures, rc = ETRIS_OK;
+  uint32_t j;
+  ETRIS e;
+
+  if (etris_archive_game(a, g, &game, &log, NULL) != ETRIS_OK)
+    return ETRIS_ERR;
+  entry = &a->entries[g];
+
+  if ((e = e_start(&game)) == NULL)
+    return ETRIS_ERR_NOMEM;
+  if ((snapshot = malloc(entry->snapshot_size)) == NULL) {
+    etris_destroy(e);
+    return ETRIS_ERR_NOMEM;
+  }
+  if (etris_snapshot_size(e) != entry->snapshot_size)
+    rc = ETRIS_ERR;
+
+  /* pass the keyframes as the writer took them */
+  for (j = 0; j < entry->n_keyframes && rc == ETRIS_OK; j++) {
+    if (j > 0 && 
+	etris_replay_to(e, log, entry->length, &pos, pos.ticks + a->header->interval) == ETRIS_ERR)
+      rc = ETRIS_ERR;
+    k = a->map + entry->keyframes + j * E_KEYFRAME_SIZE(entry->snapshot_size);
+    memcpy(&kf, k, sizeof(kf));
+    etris_snapshot(e, snapshot);
+    if (kf.offset != pos.offset || kf.ticks != pos.ticks || kf.partial != pos.partial ||
+	memcmp(k + sizeof(kf), snapshot, entry->snapshot_size) != 0)
+      rc = ETRIS_ERR;
+  }
+
+  if (rc == ETRIS_OK &&
+      etris_replay_to(e, log, entry->length, &pos, ULONG_MAX) == ETRIS_ERR)
+    rc = ETRIS_ERR;
+
+  etris_score(e, &score, &lines, &figures);
+  if (score != game.score || lines != game.lines || figures != game.figures || 
+      pos.ticks != entry->ticks)
+    rc = ETRIS_ERR;
+
+  free(snapshot);
+  etris_destroy(e);
+  return rc;
+}
@@ -0,0 +1,165 @@
+/* etris-archive.h -- archives of recorded games with random access, public API.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ETRIS_ARCHIVE_H
+#define __ETRIS_ARCHIVE_H
+
+#include "etris.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* handle to an archive being written */
+typedef struct e_archive_writer * ETRIS_ARCHIVE_WRITER;
+
+/* handle to an archive mapped for reading */
+typedef struct e_archive * ETRIS_ARCHIVE;
+
+/* A game in an archive. Games start from a new instance of the given 
+ * dimensions, etris_set_sequence() with `sequence' and `seed', then 
+ * etris_reset(), and go on with the input of their log. */
+struct etris_archive_game {
+  int width;
+  int height;
+  int border;
+  int sequence;
+  unsigned int seed;
+  int score;
+  int lines;
+  int figures;
+  unsigned long ticks;
+};
+
+/** 
+ * Create new archive file. Games are written as they are added, only the 
+ * index is kept in memory until etris_archive_finish().
+ *
+ * @param path Name of archive file
+ * @param interval Time ticks between keyframes, the snapshots seeking
+ *        starts replay from
+ * @return Archive writer or NULL on error
+ */
+ETRIS_ARCHIVE_WRITER etris_archive_create(const char *path, unsigned long interval);
+
+/** 
+ * Add game with input log recorded by etris_record(). The log is replayed
+ * to take keyframes and final score.
+ *
+ * @param w The archive writer
+ * @param game Dimensions, sequence and seed of game, the rest is filled in
+ * @param log Input log
+ * @param length Length of log in bytes
+ * @return ETRIS_OK, ETRIS_ERR if the log does not replay or writing failed
+ *         or ETRIS_ERR_NOMEM
+ */
+int etris_archive_add(ETRIS_ARCHIVE_WRITER w, struct etris_archive_game *game, 
+		      const unsigned char *log, size_t length);
+
+/** 
+ * Write index, close archive file and destroy writer.
+ *
+ * @param w The archive writer
+ * @return ETRIS_OK or ETRIS_ERR if writing failed
+ */
+int etris_archive_finish(ETRIS_ARCHIVE_WRITER w);
+
+/** 
+ * Map archive file for reading. Nothing but the header and the index is
+ * checked, games are read as they are looked at: keyframes are checked as
+ * they are restored and logs as they are replayed. Keyframes are 
+ * snapshots, so archives are only portable between builds of the same 
+ * library.
+ *
+ * @param path Name of archive file
+ * @return Archive or NULL on error
+ */
+ETRIS_ARCHIVE etris_archive_open(const char *path);
+
+/** 
+ * Unmap archive file.
+ *
+ * @param a The archive
+ */
+void etris_archive_close(ETRIS_ARCHIVE a);
+
+/** 
+ * Get number of games in archive.
+ *
+ * @param a The archive
+ * @return Number of games
+ */
+int etris_archive_games(ETRIS_ARCHIVE a);
+
+/** 
+ * Get game `g' of archive and its input log. The log points into the 
+ * mapped file and is valid until the archive is closed.
+ *
+ * @param a The archive
+ * @param g Game number, from 0
+ * @param game Where to store game, or NULL
+ * @param log Where to store input log, or NULL
+ * @param length Where to store length of input log, or NULL
+ * @return ETRIS_OK or ETRIS_ERR if there is no such game
+ */
+int etris_archive_game(ETRIS_ARCHIVE a, int g, struct etris_archive_game *game, 
+		       const unsigned char **log, size_t *length);
+
+/** 
+ * Bring `e' to the state of game `g' at time tick `tick', restoring the 
+ * closest keyframe before it and replaying from there. The instance must
+ * have the dimensions of the game, its hooks are called as usual.
+ *
+ * @param a The archive
+ * @param g Game number, from 0
+ * @param tick Time tick to seek to, ticks past the end seek to the end
+ * @param e The etris instance
+ * @return ETRIS_OK, ETRIS_GAME_OVER if the game is over by then or 
+ *         ETRIS_ERR if there is no such game, `e' does not fit or the 
+ *         game is corrupt
+ */
+int etris_archive_seek(ETRIS_ARCHIVE a, int g, unsigned long tick, ETRIS e);
+
+/** 
+ * Replay game `g' from its start and check that it passes all keyframes
+ * and ends with the score stored in the index.
+ *
+ * @param a The archive
+ * @param g Game number, from 0
+ * @return ETRIS_OK, ETRIS_ERR if the game does not match or 
+ *         ETRIS_ERR_NOMEM
+ */
+int etris_archive_verify(ETRIS_ARCHIVE a, int g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETRIS_ARCHIVE_H */
@@ -0,0 +1,267 @@
+/* etris-archiver.c -- build, verify and extract from archives of recorded games
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "etris.h"
+#include "etris-archive.h"
+
+static const char *sequences[] = {"cycle", "uniform", "bag"};
+
+#define SEQUENCES ((int)(sizeof(sequences) / sizeof(sequences[0])))
+
+static int usage(const char *name)
+{
+  printf("usage: %s build ARCHIVE INTERVAL LOG:WxH+B:SEQUENCE:SEED...\n"
+	 "       %s list ARCHIVE\n"
+	 "       %s verify ARCHIVE\n"
+	 "       %s extract ARCHIVE GAME LOG\n"
+	 "       %s show ARCHIVE GAME TICK\n"
+	 "SEQUENCE is one of cycle, uniform or bag. A log is the raw input\n"
+	 "recorded by etris_record(), extract prints its spec for build.\n",
+	 name, name, name, name, name);
+  return 1;
+}
+
+static void print_spec(const char *file, const struct etris_archive_game *game)
+{
+  printf("%s:%dx%d+%d:%s:%u\n", file, game->width, game->height, game->border,
+	 game->sequence >= 0 && game->sequence < SEQUENCES ? sequences[game->sequence] : "?", 
+	 game->seed);
+}
+
+/* Read whole file, returns NULL on error. */
+static unsigned char *read_file(const char *file, size_t *length)
+{
+  unsigned char *p = NULL, *q;
+  size_t size = 0, n;
+  FILE *f;
+
+  if ((f = fopen(file, "rb")) == NULL)
+    return NULL;
+
+  *length = 0;
+  do {
+    if (*length == size) {
+      size = size * 2 + 4096;
+      if ((q = realloc(p, size)) == NULL) {
+	free(p);
+	fclose(f);
+	return NULL;
+      }
+      p = q;
+    }
+    n = fread(p + *length, 1, size - *length, f);
+    *length += n;
+  } while (n > 0);
+
+  if (ferror(f)) {
+    free(p);
+    p = NULL;
+  }
+  fclose(f);
+  return p;
+}
+
+static int build(const char *path, unsigned long interval, int n, char **specs)
+{
+  struct etris_archive_game game;
+  ETRIS_ARCHIVE_WRITER w;
+  unsigned char *log;
+  size_t length;
+  char *file, *sequence, *p;
+  int i, failed = 0;
+
+  if ((w = etris_archive_create(path, interval)) == NULL) {
+    printf("Failed to create %s\n", path);
+    return 1;
+  }
+
+  for (i = 0; i < n; i++) {
+    memset(&game, 0, sizeof(game));
+    file = specs[i];
+    if ((p = strchr(file, ':')) == NULL || 
+	sscanf(p + 1, "%dx%d+%d:", &game.width, &game.height, &game.border) != 3 ||
+	(sequence = strchr(p + 1, ':')) == NULL || (p = strchr(sequence + 1, ':')) == NULL) {
+      printf("Bad spec %s\n", specs[i]);
+      failed = 1;
+      continue;
+    }
+    *strchr(file, ':') = '\0';
+    *p = '\0';
+    game.seed = strtoul(p + 1, NULL, 0);
+    for (game.sequence = 0; game.sequence < SEQUENCES; game.sequence++)
+      if (strcmp(sequence + 1, sequences[game.sequence]) == 0)
+	break;
+
+    if (game.sequence == SEQUENCES || (log = read_file(file, &length)) == NULL) {
+      printf("Bad sequence or unreadable log %s\n", file);
+      failed = 1;
+      continue;
+    }
+    if (etris_archive_add(w, &game, log, length) != ETRIS_OK) {
+      printf("Log %s does not replay\n", file);
+      failed = 1;
+    }
+    free(log);
+  }
+
+  if (etris_archive_finish(w) != ETRIS_OK) {
+    printf("Failed to write %s\n", path);
+    return 1;
+  }
+  return failed;
+}
+
+static int list(ETRIS_ARCHIVE a)
+{
+  struct etris_archive_game game;
+  size_t length;
+  int g;
+
+  printf("%8s %10s %8s %8s %8s %12s %10s\n", "game", "field", "sequence", 
+	 "score", "lines", "ticks", "log bytes");
+  for (g = 0; g < etris_archive_games(a); g++) {
+    etris_archive_game(a, g, &game, NULL, &length);
+    printf("%8d %4dx%d+%d %8s %8d %8d %12lu %10lu\n", g, game.width, game.height, 
+	   game.border, game.sequence >= 0 && game.sequence < SEQUENCES ? 
+	   sequences[game.sequence] : "?", game.score, game.lines, game.ticks, 
+	   (unsigned long)length);
+  }
+  return 0;
+}
+
+static int verify(ETRIS_ARCHIVE a)
+{
+  int g, rc, bad = 0;
+
+  for (g = 0; g < etris_archive_games(a); g++) {
+    if ((rc = etris_archive_verify(a, g)) != ETRIS_OK) {
+      printf("game %d: %s\n", g, rc == ETRIS_ERR_NOMEM ? "out of memory" : "mismatch");
+      bad++;
+    }
+  }
+  printf("verified %d games, %d bad\n", etris_archive_games(a), bad);
+  return bad ? 1 : 0;
+}
+
+static int extract(ETRIS_ARCHIVE a, int g, const char *file)
+{
+  struct etris_archive_game game;
+  const unsigned char *log;
+  size_t length;
+  FILE *f;
+
+  if (etris_archive_game(a, g, &game, &log, &length) != ETRIS_OK) {
+    printf("No game %d\n", g);
+    return 1;
+  }
+  if ((f = fopen(file, "wb")) == NULL || fwrite(log, 1, length, f) != length || 
+      fclose(f) != 0) {
+    printf("Failed to write %s\n", file);
+    return 1;
+  }
+  print_spec(file, &game);
+  return 0;
+}
+
+static int show(ETRIS_ARCHIVE a, int g, unsigned long tick)
+{
+  static const char blocks[] = " #*ABCDEFG";
+  struct etris_archive_game game;
+  unsigned char *cells, *dirty;
+  int x, y, rc, score, lines, figures, stride;
+  ETRIS e;
+
+  if (etris_archive_game(a, g, &game, NULL, NULL) != ETRIS_OK || 
+      (e = etris_create(game.width, game.height, game.border, NULL, NULL)) == NULL) {
+    printf("No game %d\n", g);
+    return 1;
+  }
+  stride = game.width + 2 * game.border;
+  cells = malloc(stride * (game.height + game.border));
+  dirty = malloc((game.height + game.border + 7) / 8);
+  if (cells == NULL || dirty == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  rc = etris_archive_seek(a, g, tick, e);
+  etris_set_framebuffer(e, cells, dirty);
+  etris_score(e, &score, &lines, &figures);
+
+  for (y = 0; y < game.height + game.border; y++) {
+    for (x = 0; x < stride; x++)
+      putchar(cells[y * stride + x] < sizeof(blocks) - 1 ? blocks[cells[y * stride + x]] : '?');
+    putchar('\n');
+  }
+  printf("game %d tick %lu: score %d, lines %d, figures %d%s\n", g, tick, 
+	 score, lines, figures, rc == ETRIS_GAME_OVER ? ", game over" : "");
+
+  free(dirty);
+  free(cells);
+  etris_destroy(e);
+  return rc == ETRIS_ERR;
+}
+
+int main(int argc, char **argv)
+{
+  ETRIS_ARCHIVE a;
+  int rc;
+
+  if (argc < 3)
+    return usage(argv[0]);
+
+  if (strcmp(argv[1], "build") == 0)
+    return argc < 4 ? usage(argv[0]) : build(argv[2], strtoul(argv[3], NULL, 0), argc - 4, argv + 4);
+
+  if ((a = etris_archive_open(argv[2])) == NULL) {
+    printf("Failed to open %s\n", argv[2]);
+    return 1;
+  }
+
+  if (strcmp(argv[1], "list") == 0)
+    rc = list(a);
+  else if (strcmp(argv[1], "verify") == 0)
+    rc = verify(a);
+  else if (strcmp(argv[1], "extract") == 0 && argc == 5)
+    rc = extract(a, atoi(argv[3]), argv[4]);
+  else if (strcmp(argv[1], "show") == 0 && argc == 5)
+    rc = show(a, atoi(argv[3]), strtoul(argv[4], NULL, 0));
+  else
+    rc = usage(argv[0]);
+
+  etris_archive_close(a);
+  return rc;
+}
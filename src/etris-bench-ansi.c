@@ -0,0 +1,235 @@
+/* etris-bench-ansi.c -- benchmark of terminal output per figure placed, minimal
+ * diff against repainting the screen or changed rows.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "etris.h"
+#include "etris-ansi.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define STRIDE (FIELD_WIDTH + FIELD_BORDER * 2)
+#define ROWS (FIELD_HEIGHT + FIELD_BORDER)
+
+/* screen columns, two per block and the score to the right */
+#define COLUMNS (STRIDE * 2 + 24)
+#define SCORE_COLUMN (STRIDE * 2 + 2)
+
+#define DEFAULT_GAMES 20
+#define DEFAULT_FIGURES 300
+
+/* 256 color palette index for each block color, as etris-term */
+static int color[] = {
+  238, 248, 15, 203, 83, 63, 227, 207, 87, 244
+};
+
+/* what the engine drew, rows drawn to and score, since the last frame */
+static int cells[ROWS][STRIDE];
+static int dirty[ROWS];
+static int score[3];
+
+static ETRIS_ANSI screen;
+
+/* output bytes of each way to render */
+static unsigned long naive_bytes, rows_bytes, diff_bytes;
+static unsigned long frames, blocks;
+
+static void draw_block(int x, int y, int c)
+{
+  char block[3] = "  ";
+
+  cells[y][x] = c;
+  dirty[y] = 1;
+  blocks++;
+  etris_ansi_put(screen, x * 2, y, block, color[c]);
+}
+
+static void update_score(int s, int lines, int figures)
+{
+  char text[32];
+
+  score[0] = s;
+  score[1] = lines;
+  score[2] = figures;
+  sprintf(text, "Score: %-10d", s);
+  etris_ansi_put(screen, SCORE_COLUMN, 1, text, ETRIS_ANSI_DEFAULT);
+  sprintf(text, "Lines: %-10d", lines);
+  etris_ansi_put(screen, SCORE_COLUMN, 2, text, ETRIS_ANSI_DEFAULT);
+  sprintf(text, "Figures: %-10d", figures);
+  etris_ansi_put(screen, SCORE_COLUMN, 3, text, ETRIS_ANSI_DEFAULT);
+}
+
+static void count(const char *data, size_t n, void *context)
+{
+  *(unsigned long *)context += n;
+}
+
+/* Bytes of row `y' painted as etris-term does, colors set on change. */
+static int paint_row(int y, int every_block)
+{
+  char buf[64];
+  int x, c, last = -1, n;
+
+  n = sprintf(buf, "\033[%d;1H", y + 1);
+  for (x = 0; x < STRIDE; x++) {
+    if ((c = cells[y][x]) != last || every_block)
+      n += sprintf(buf, "\033[48;5;%dm", color[c]);
+    last = c;
+    n += 2;
+  }
+  return n + (int)strlen("\033[0m");
+}
+
+static int paint_score(void)
+{
+  char buf[128];
+
+  return sprintf(buf, "\033[2;%dHScore: %d\033[3;%dHLines: %d\033[4;%dHFigures: %d",
+		 SCORE_COLUMN + 1, score[0], SCORE_COLUMN + 1, score[1], 
+		 SCORE_COLUMN + 1, score[2]);
+}
+
+/* Show what changed since the last frame, in all three ways. */
+static void frame(void)
+{
+  int y;
+
+  /* the whole screen, one color sequence per block */
+  naive_bytes += strlen("\033[2J");
+  for (y = 0; y < ROWS; y++)
+    naive_bytes += paint_row(y, 1);
+  naive_bytes += paint_score();
+
+  /* rows drawn to, like etris-term */
+  for (y = 0; y < ROWS; y++)
+    if (dirty[y])
+      rows_bytes += paint_row(y, 0);
+  rows_bytes += paint_score();
+  memset(dirty, 0, sizeof(dirty));
+
+  etris_ansi_flush(screen);
+  frames++;
+}
+
+static unsigned int random_next(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+/* Play like a player would, one input or a few ticks at a time, showing
+ * a frame after each that redrew. */
+static void play(ETRIS e, int max, unsigned int seed)
+{
+  struct etris_placement p;
+  int i, j, x, r, figures, before;
+
+  for (i = 0; i < max && etris_best_move(e, &p) == ETRIS_OK; i++) {
+    for (j = 0; j < 4 && (etris_figure(e, NULL, NULL, NULL, &r), r != p.r); j++) {
+      if (etris_advance(e, 5 + random_next(&seed) % 10) != ETRIS_OK)
+	frame();
+      if (etris_rotate(e) != ETRIS_OK)
+	frame();
+    }
+    for (j = 0; j < FIELD_WIDTH && (etris_figure(e, NULL, &x, NULL, NULL), x != p.x); j++) {
+      if (etris_advance(e, 5 + random_next(&seed) % 10) != ETRIS_OK)
+	frame();
+      if ((x < p.x ? etris_right(e) : etris_left(e)) != ETRIS_OK)
+	frame();
+    }
+    etris_drop(e);
+
+    etris_score(e, NULL, NULL, &before);
+    do {
+      if ((j = etris_deadline(e)) < 0)
+	return;
+      if (etris_advance(e, j) != ETRIS_OK)
+	frame();
+      etris_score(e, NULL, NULL, &figures);
+    } while (figures == before);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int g, figures, total = 0;
+  ETRIS e;
+  int n_games = argc > 1 ? atoi(argv[1]) : DEFAULT_GAMES;
+  int max_figures = argc > 2 ? atoi(argv[2]) : DEFAULT_FIGURES;
+
+  if (n_games < 1 || max_figures < 1) {
+    printf("usage: %s [games] [figures per game]\n", argv[0]);
+    return 1;
+  }
+
+  if ((screen = etris_ansi_create(COLUMNS, ROWS, count, &diff_bytes)) == NULL) {
+    printf("Failed to create screen\n");
+    return 1;
+  }
+
+  for (g = 0; g < n_games; g++) {
+    /* a spectator joining, the first frame paints the field */
+    etris_ansi_invalidate(screen);
+    if ((e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, draw_block, update_score)) == NULL) {
+      printf("Failed to create etris instance\n");
+      return 1;
+    }
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+    frame();
+
+    play(e, max_figures, g + 1);
+    etris_score(e, NULL, NULL, &figures);
+    total += figures;
+    etris_destroy(e);
+  }
+
+  printf("games %d, figures %d, frames %lu, %.1f frames/figure, %.1f blocks drawn/frame\n", 
+	 n_games, total, frames, (double)frames / total, (double)blocks / frames);
+  printf("%-18s %12s %12s %12s\n", "", "bytes", "bytes/figure", "bytes/frame");
+  printf("%-18s %12lu %12.1f %12.1f\n", "full repaint", naive_bytes, 
+	 (double)naive_bytes / total, (double)naive_bytes / frames);
+  printf("%-18s %12lu %12.1f %12.1f\n", "changed rows", rows_bytes, 
+	 (double)rows_bytes / total, (double)rows_bytes / frames);
+  printf("%-18s %12lu %12.1f %12.1f\n", "shadow screen diff", diff_bytes, 
+	 (double)diff_bytes / total, (double)diff_bytes / frames);
+
+  etris_ansi_destroy(screen);
+  return 0;
+}
@@ -0,0 +1,245 @@
+/* etris-bench-archive.c -- measure seek latency in a large archive of games
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "etris.h"
+#include "etris-archive.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_GAMES 300000
+#define DEFAULT_INTERVAL 1000
+#define DEFAULT_SEEKS 20000
+
+/* different games played by the bot, the archive repeats them */
+#define DISTINCT 64
+#define FIGURES 300
+
+#define LOG_MAX (64 * 1024)
+
+struct game {
+  struct etris_archive_game game;
+  unsigned char *log;
+  size_t length;
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int random_next(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+/* Play like etris-bench-replay does, moving figures with thinking time. */
+static void play(ETRIS e, unsigned int seed)
+{
+  struct etris_placement p;
+  int i, j, x, r, figures, before;
+
+  for (i = 0; i < FIGURES && etris_best_move(e, &p) == ETRIS_OK; i++) {
+    etris_advance(e, 5 + random_next(&seed) % 20);
+    for (j = 0; j < 4 && (etris_figure(e, NULL, NULL, NULL, &r), r != p.r); j++)
+      etris_rotate(e);
+    for (j = 0; j < FIELD_WIDTH && (etris_figure(e, NULL, &x, NULL, NULL), x != p.x); j++)
+      x < p.x ? etris_right(e) : etris_left(e);
+    etris_drop(e);
+
+    etris_score(e, NULL, NULL, &before);
+    do {
+      if ((j = etris_deadline(e)) < 0)
+	return;
+      etris_advance(e, j);
+      etris_score(e, NULL, NULL, &figures);
+    } while (figures == before);
+  }
+}
+
+static int compare(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Seek to random ticks of random games, from keyframes or from the start,
+ * and print latency percentiles. */
+static void seeks(ETRIS_ARCHIVE a, ETRIS e, int n, int keyframes, const char *name)
+{
+  struct etris_archive_game game;
+  struct etris_replay_pos pos;
+  const unsigned char *log;
+  size_t length;
+  double *t, sum = 0;
+  unsigned int x = 12345;
+  int i, g;
+
+  if ((t = malloc(n * sizeof(double))) == NULL)
+    return;
+
+  for (i = 0; i < n; i++) {
+    g = random_next(&x) % etris_archive_games(a);
+    etris_archive_game(a, g, &game, &log, &length);
+
+    t[i] = now();
+    if (keyframes)
+      etris_archive_seek(a, g, random_next(&x) % (game.ticks + 1), e);
+    else {
+      memset(&pos, 0, sizeof(pos));
+      etris_set_sequence(e, game.sequence, game.seed);
+      etris_reset(e);
+      etris_replay_to(e, log, length, &pos, random_next(&x) % (game.ticks + 1));
+    }
+    t[i] = now() - t[i];
+    sum += t[i];
+  }
+
+  qsort(t, n, sizeof(double), compare);
+  printf("%-22s %10d %10.1f %10.1f %10.1f %10.1f\n", name, n, sum / n * 1e6, 
+	 t[n / 2] * 1e6, t[n * 99 / 100] * 1e6, t[n - 1] * 1e6);
+  free(t);
+}
+
+int main(int argc, char **argv)
+{
+  struct game distinct[DISTINCT];
+  ETRIS_ARCHIVE_WRITER w;
+  ETRIS_ARCHIVE a;
+  unsigned char *log;
+  double t;
+  long size;
+  int g, fd;
+  ETRIS e;
+  const char *path = argc > 1 ? argv[1] : "etris-bench.eta";
+  int games = argc > 2 ? atoi(argv[2]) : DEFAULT_GAMES;
+  unsigned long interval = argc > 3 ? strtoul(argv[3], NULL, 0) : DEFAULT_INTERVAL;
+  int n = argc > 4 ? atoi(argv[4]) : DEFAULT_SEEKS;
+
+  if (games < 1 || interval < 1 || n < 1) {
+    printf("usage: %s [archive] [games] [keyframe interval] [seeks]\n", argv[0]);
+    return 1;
+  }
+
+  if ((log = malloc(LOG_MAX)) == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+  for (g = 0; g < DISTINCT; g++) {
+    memset(&distinct[g].game, 0, sizeof(struct etris_archive_game));
+    distinct[g].game.width = FIELD_WIDTH;
+    distinct[g].game.height = FIELD_HEIGHT;
+    distinct[g].game.border = FIELD_BORDER;
+    distinct[g].game.sequence = ETRIS_SEQUENCE_BAG;
+    distinct[g].game.seed = g;
+
+    e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL);
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+    etris_record(e, log, LOG_MAX);
+    play(e, g + 1);
+    etris_record_length(e, &distinct[g].length);
+    etris_destroy(e);
+
+    if ((distinct[g].log = malloc(distinct[g].length)) == NULL) {
+      printf("Out of memory\n");
+      return 1;
+    }
+    memcpy(distinct[g].log, log, distinct[g].length);
+  }
+  free(log);
+
+  t = now();
+  if ((w = etris_archive_create(path, interval)) == NULL) {
+    printf("Failed to create %s\n", path);
+    return 1;
+  }
+  for (g = 0; g < games; g++) {
+    if (etris_archive_add(w, &distinct[g % DISTINCT].game, distinct[g % DISTINCT].log, 
+			  distinct[g % DISTINCT].length) != ETRIS_OK) {
+      printf("Failed to add game %d\n", g);
+      return 1;
+    }
+  }
+  if (etris_archive_finish(w) != ETRIS_OK) {
+    printf("Failed to write %s\n", path);
+    return 1;
+  }
+  t = now() - t;
+
+  /* drop the archive from the page cache, so the first seeks go to disk */
+  if ((fd = open(path, O_RDONLY)) >= 0) {
+    size = (long)lseek(fd, 0, SEEK_END);
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+  else
+    size = 0;
+
+  printf("archive %s: %d games, %.1f MB, keyframe every %lu ticks, built in %.1f s\n", 
+	 path, games, size / 1e6, interval, t);
+
+  if ((a = etris_archive_open(path)) == NULL || 
+      (e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL)) == NULL) {
+    printf("Failed to open %s\n", path);
+    return 1;
+  }
+
+  printf("%-22s %10s %10s %10s %10s %10s\n", "seek", "seeks", "mean us", "p50 us", 
+	 "p99 us", "max us");
+  seeks(a, e, n, 1, "keyframe, cold cache");
+  seeks(a, e, n, 1, "keyframe, warm cache");
+  seeks(a, e, n / 10 > 0 ? n / 10 : 1, 0, "from start");
+
+  etris_destroy(e);
+  etris_archive_close(a);
+  for (g = 0; g < DISTINCT; g++)
+    free(distinct[g].log);
+  return 0;
+}
@@ -0,0 +1,132 @@
+/* etris-bench-env.c -- measure steps per second of the batch environment
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "etris.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+
+#define DEFAULT_GAMES 1024
+#define DEFAULT_STEPS 2000
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int random_next(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char *observations, *masks, *dones;
+  float *rewards;
+  int *actions;
+  double t_step = 0, t_mask = 0, t, lines = 0;
+  long done = 0;
+  unsigned int seed = 1;
+  int i, a, k, s, n_actions;
+  ETRIS_ENV env;
+  int games = argc > 1 ? atoi(argv[1]) : DEFAULT_GAMES;
+  int steps = argc > 2 ? atoi(argv[2]) : DEFAULT_STEPS;
+
+  if (games < 1 || steps < 1) {
+    printf("usage: %s [games] [steps]\n", argv[0]);
+    return 1;
+  }
+
+  if ((env = etris_env_create(games, FIELD_WIDTH, FIELD_HEIGHT, 1)) == NULL) {
+    printf("Failed to create environment\n");
+    return 1;
+  }
+  n_actions = etris_env_actions(env);
+  observations = malloc(games * etris_env_observation_size(env));
+  masks = malloc(games * n_actions);
+  actions = malloc(games * sizeof(int));
+  rewards = malloc(games * sizeof(float));
+  dones = malloc(games);
+  if (!observations || !masks || !actions || !rewards || !dones) {
+    printf("Out of memory\n");
+    return 1;
+  }
+  etris_env_observe(env, observations);
+
+  for (s = 0; s < steps; s++) {
+    t = now();
+    etris_env_masks(env, masks);
+    t_mask += now() - t;
+
+    /* random valid action, a stand-in for the agent */
+    for (i = 0; i < games; i++) {
+      a = random_next(&seed) % n_actions;
+      for (k = 0; k < n_actions && !masks[i * n_actions + a]; k++)
+	a = (a + 1) % n_actions;
+      actions[i] = a;
+    }
+
+    t = now();
+    etris_env_step(env, actions, observations, rewards, dones);
+    t_step += now() - t;
+
+    for (i = 0; i < games; i++) {
+      lines += rewards[i];
+      done += dones[i];
+    }
+  }
+
+  printf("games %d, steps %d, observation %lu bytes, actions %d\n", games, steps, 
+	 (unsigned long)etris_env_observation_size(env), n_actions);
+  printf("step %.0f steps/sec, masks %.0f steps/sec, both %.0f steps/sec per core\n", 
+	 games * (double)steps / t_step, games * (double)steps / t_mask, 
+	 games * (double)steps / (t_step + t_mask));
+  printf("episodes done %ld, lines %.0f\n", done, lines);
+
+  etris_env_destroy(env);
+  free(observations);
+  free(masks);
+  free(actions);
+  free(rewards);
+  free(dones);
+  return 0;
+}
@@ -0,0 +1,163 @@
+/* etris-bench-pool.c -- measure ticking many games, pooled vs. individually
+ * created instances.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "etris.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_INSTANCES 10000
+#define DEFAULT_TICKS 2000
+
+/* ticks per second as expected by etris_tick() */
+#define TICK_RATE 100
+
+static void draw_block(int x, int y, int c)
+{
+}
+
+static void update_score(int score, int lines, int figures)
+{
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, int n, int ticks, double secs)
+{
+  double ns = secs * 1e9 / ((double)n * ticks);
+
+  printf("%-10s %8d instances %6d ticks  %8.1f ns/tick  %10.0f instances/core at %d Hz\n", 
+	 name, n, ticks, ns, 1e9 / (ns * TICK_RATE), TICK_RATE);
+}
+
+/* Tick pooled instances either with etris_pool_tick() or one by one with 
+ * etris_tick(), to tell packing and batched ticking apart. */
+static double bench_pool(int n, int ticks, int batch)
+{
+  ETRIS_POOL p;
+  ETRIS e;
+  double t;
+  int i, j;
+
+  if ((p = etris_pool_create(n, FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, 
+			     draw_block, update_score)) == NULL) {
+    printf("Failed to create etris pool\n");
+    exit(1);
+  }
+
+  t = now();
+  for (i = 0; i < ticks; i++) {
+    if (batch) {
+      etris_pool_tick(p);
+      continue;
+    }
+    for (j = 0; j < n; j++) {
+      e = etris_pool_get(p, j);
+      if (etris_tick(e) == ETRIS_GAME_OVER)
+	etris_reset(e);
+    }
+  }
+  t = now() - t;
+
+  etris_pool_destroy(p);
+  return t;
+}
+
+/* Instances are created one by one with some unrelated allocations in 
+ * between, as they would be in a long running server. */
+static double bench_individual(int n, int ticks)
+{
+  ETRIS *e;
+  void **spacers;
+  double t;
+  int i, j;
+
+  e = malloc(n * sizeof(ETRIS));
+  spacers = malloc(n * sizeof(void *));
+  if (!e || !spacers) {
+    printf("Out of memory\n");
+    exit(1);
+  }
+
+  for (i = 0; i < n; i++) {
+    spacers[i] = malloc(64 + (i * 37) % 512);
+    if ((e[i] = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, 
+			     draw_block, update_score)) == NULL) {
+      printf("Failed to create etris instance\n");
+      exit(1);
+    }
+  }
+
+  t = now();
+  for (i = 0; i < ticks; i++)
+    for (j = 0; j < n; j++)
+      if (etris_tick(e[j]) == ETRIS_GAME_OVER)
+	etris_reset(e[j]);
+  t = now() - t;
+
+  for (i = 0; i < n; i++) {
+    etris_destroy(e[i]);
+    free(spacers[i]);
+  }
+  free(spacers);
+  free(e);
+  return t;
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : DEFAULT_INSTANCES;
+  int ticks = argc > 2 ? atoi(argv[2]) : DEFAULT_TICKS;
+
+  if (n < 1 || ticks < 1) {
+    printf("usage: %s [instances] [ticks]\n", argv[0]);
+    return 1;
+  }
+
+  report("pool", n, ticks, bench_pool(n, ticks, 1));
+  report("pool-loop", n, ticks, bench_pool(n, ticks, 0));
+  report("individual", n, ticks, bench_individual(n, ticks));
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+/* etris-bench-replay.c -- record bot games as input logs, replay and verify them
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "etris.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_GAMES 200
+#define DEFAULT_FIGURES 300
+
+/* ticks per second the engine is tuned for */
+#define TICKS_PER_SECOND 100
+
+/* room for the log of one game */
+#define LOG_MAX (64 * 1024)
+
+struct game {
+  size_t offset;
+  size_t length;
+  int score;
+  int lines;
+  int figures;
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int random_next(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+/* Play up to `max' figures like a player would, moving each figure to the
+ * bot's choice with some thinking time in between. Returns ticks played. */
+static long play(ETRIS e, int max, unsigned int seed)
+{
+  struct etris_placement p;
+  long ticks = 0;
+  int i, j, x, r, figures, before;
+
+  for (i = 0; i < max && etris_best_move(e, &p) == ETRIS_OK; i++) {
+    j = 5 + random_next(&seed) % 20;
+    etris_advance(e, j);
+    ticks += j;
+
+    for (j = 0; j < 4 && (etris_figure(e, NULL, NULL, NULL, &r), r != p.r); j++)
+      etris_rotate(e);
+    for (j = 0; j < FIELD_WIDTH && (etris_figure(e, NULL, &x, NULL, NULL), x != p.x); j++)
+      x < p.x ? etris_right(e) : etris_left(e);
+    etris_drop(e);
+
+    /* wait for the next figure */
+    etris_score(e, NULL, NULL, &before);
+    do {
+      if ((j = etris_deadline(e)) < 0)
+	return ticks;
+      etris_advance(e, j);
+      ticks += j;
+      etris_score(e, NULL, NULL, &figures);
+    } while (figures == before);
+  }
+
+  return ticks;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char *log, *logs = NULL;
+  struct game *games;
+  size_t bytes = 0, length;
+  double t_record, t_replay;
+  long ticks = 0, figures = 0;
+  int g, score, lines, n, mismatches = 0;
+  ETRIS e;
+  int n_games = argc > 1 ? atoi(argv[1]) : DEFAULT_GAMES;
+  int max_figures = argc > 2 ? atoi(argv[2]) : DEFAULT_FIGURES;
+
+  if (n_games < 1 || max_figures < 1) {
+    printf("usage: %s [games] [figures per game]\n", argv[0]);
+    return 1;
+  }
+
+  if ((games = malloc(n_games * sizeof(struct game))) == NULL || 
+      (log = malloc(LOG_MAX)) == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  t_record = now();
+  for (g = 0; g < n_games; g++) {
+    if ((e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL)) == NULL) {
+      printf("Failed to create etris instance\n");
+      return 1;
+    }
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+
+    etris_record(e, log, LOG_MAX);
+    ticks += play(e, max_figures, g + 1);
+    if (etris_record_length(e, &length) != ETRIS_OK) {
+      printf("Game %d does not fit in %d bytes\n", g, LOG_MAX);
+      return 1;
+    }
+
+    etris_score(e, &games[g].score, &games[g].lines, &games[g].figures);
+    figures += games[g].figures;
+    etris_destroy(e);
+
+    if ((logs = realloc(logs, bytes + length)) == NULL) {
+      printf("Out of memory\n");
+      return 1;
+    }
+    memcpy(logs + bytes, log, length);
+    games[g].offset = bytes;
+    games[g].length = length;
+    bytes += length;
+  }
+  t_record = now() - t_record;
+
+  t_replay = now();
+  for (g = 0; g < n_games; g++) {
+    e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL);
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+
+    if (etris_replay(e, logs + games[g].offset, games[g].length) == ETRIS_ERR)
+      mismatches++;
+    else {
+      etris_score(e, &score, &lines, &n);
+      if (score != games[g].score || lines != games[g].lines || n != games[g].figures)
+	mismatches++;
+    }
+    etris_destroy(e);
+  }
+  t_replay = now() - t_replay;
+
+  printf("games %d, figures %ld, ticks %ld (%.1f hours of play)\n", 
+	 n_games, figures, ticks, ticks / (3600.0 * TICKS_PER_SECOND));
+  printf("log %lu bytes, %.1f bytes/game, %.2f bytes/figure\n", 
+	 (unsigned long)bytes, (double)bytes / n_games, (double)bytes / figures);
+  printf("record %.3f s, replay %.3f s, %.0f games/sec, %.0fx real time\n", 
+	 t_record, t_replay, n_games / t_replay, 
+	 ticks / (double)TICKS_PER_SECOND / t_replay);
+  printf("verified %d games, %d mismatches\n", n_games, mismatches);
+
+  free(logs);
+  free(log);
+  free(games);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/* etris-bench-rollout.c -- measure Monte Carlo rollouts per second as the
+ * number of threads grows.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "etris.h"
+#include "etris-rollout.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_ROLLOUTS 256
+#define DEFAULT_DEPTH 8
+
+/* figures played before rolling out, to start from a realistic field */
+#define OPENING 12
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  struct etris_rollout_result results[ETRIS_MAX_PLACEMENTS];
+  struct etris_placement p;
+  ETRIS_ROLLOUT ro;
+  ETRIS e;
+  double t;
+  int i, n, b, threads;
+  int rollouts = argc > 1 ? atoi(argv[1]) : DEFAULT_ROLLOUTS;
+  int depth = argc > 2 ? atoi(argv[2]) : DEFAULT_DEPTH;
+  int max_threads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (rollouts < 1 || depth < 0 || max_threads < 1) {
+    printf("usage: %s [rollouts] [depth] [max threads]\n", argv[0]);
+    return 1;
+  }
+
+  if ((e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL)) == NULL) {
+    printf("Failed to create etris instance\n");
+    return 1;
+  }
+  for (i = 0; i < OPENING && etris_best_move(e, &p) == ETRIS_OK; i++)
+    etris_place(e, p.x, p.r);
+
+  printf("%7s %12s %12s %10s %14s\n", "threads", "placements", "rollouts", "seconds", "rollouts/sec");
+
+  for (threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+    if ((ro = etris_rollout_create(threads)) == NULL) {
+      printf("Failed to create rollout engine\n");
+      return 1;
+    }
+
+    /* first run sizes scratch memory */
+    etris_rollout_run(ro, e, 1, depth, 1, results, ETRIS_MAX_PLACEMENTS);
+
+    t = now();
+    n = etris_rollout_run(ro, e, rollouts, depth, 1, results, ETRIS_MAX_PLACEMENTS);
+    t = now() - t;
+
+    printf("%7d %12d %12d %10.3f %14.0f\n", threads, n, n * rollouts, t, n * rollouts / t);
+    etris_rollout_destroy(ro);
+
+    if (threads == max_threads)
+      break;
+  }
+
+  for (i = 1, b = 0; i < n; i++)
+    if (results[i].score > results[b].score)
+      b = i;
+  printf("best placement x %d r %d: expected score %.1f, lines %.2f, game overs %d\n", 
+	 results[b].placement.x, results[b].placement.r, results[b].score, 
+	 results[b].lines, results[b].game_overs);
+
+  etris_destroy(e);
+  return 0;
+}
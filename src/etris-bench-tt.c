@@ -0,0 +1,250 @@
+/* etris-bench-tt.c -- benchmark of rollouts with a shared transposition table,
+ * searching positions from a corpus of recorded games.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "etris.h"
+#include "etris-rollout.h"
+#include "etris-tt.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_GAMES 20
+#define DEFAULT_ROLLOUTS 64
+#define DEFAULT_DEPTH 8
+
+/* figures per recorded game and every how many figures a position is taken */
+#define FIGURES 200
+#define SAMPLE 10
+#define SAMPLES (FIGURES / SAMPLE)
+
+/* room for the log of one game */
+#define LOG_MAX (64 * 1024)
+
+/* slots of the transposition table, 16 MB */
+#define TT_ENTRIES (1 << 20)
+
+struct game {
+  unsigned char log[LOG_MAX];
+  size_t length;
+  long ticks[SAMPLES];
+  int n;
+};
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int random_next(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+/* Play a game like a player would, moving each figure to the bot's choice
+ * with some thinking time in between. Every SAMPLE figures the tick a new
+ * figure appeared at is noted as a position to search. */
+static void play(ETRIS e, struct game *g, unsigned int seed)
+{
+  struct etris_placement p;
+  long ticks = 0;
+  int i, j, x, r, figures, before;
+
+  g->n = 0;
+  for (i = 0; i < FIGURES && etris_best_move(e, &p) == ETRIS_OK; i++) {
+    if (i % SAMPLE == 0)
+      g->ticks[g->n++] = ticks;
+
+    j = 5 + random_next(&seed) % 20;
+    etris_advance(e, j);
+    ticks += j;
+
+    for (j = 0; j < 4 && (etris_figure(e, NULL, NULL, NULL, &r), r != p.r); j++)
+      etris_rotate(e);
+    for (j = 0; j < FIELD_WIDTH && (etris_figure(e, NULL, &x, NULL, NULL), x != p.x); j++)
+      x < p.x ? etris_right(e) : etris_left(e);
+    etris_drop(e);
+
+    etris_score(e, NULL, NULL, &before);
+    do {
+      if ((j = etris_deadline(e)) < 0)
+	return;
+      etris_advance(e, j);
+      ticks += j;
+      etris_score(e, NULL, NULL, &figures);
+    } while (figures == before);
+  }
+}
+
+static int same(const struct etris_rollout_result *a, 
+		const struct etris_rollout_result *b, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (a[i].placement.x != b[i].placement.x || a[i].placement.r != b[i].placement.r ||
+	a[i].game_overs != b[i].game_overs || a[i].score != b[i].score || 
+	a[i].lines != b[i].lines)
+      return 0;
+  return 1;
+}
+
+/* Search every sampled position of the corpus, returns seconds spent in
+ * rollouts. Results of the first pass are kept in `expected', later passes
+ * count positions that come out differently in `mismatches'. */
+static double search(ETRIS_ROLLOUT ro, struct game *games, int n_games, 
+		     int rollouts, int depth, struct etris_rollout_result *expected, 
+		     int *mismatches)
+{
+  struct etris_rollout_result results[ETRIS_MAX_PLACEMENTS];
+  struct etris_replay_pos pos;
+  double t = 0, t0;
+  int g, i, n, k = 0;
+  ETRIS e;
+
+  for (g = 0; g < n_games; g++) {
+    e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL);
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+    memset(&pos, 0, sizeof(pos));
+
+    for (i = 0; i < games[g].n; i++, k++) {
+      etris_replay_to(e, games[g].log, games[g].length, &pos, games[g].ticks[i]);
+
+      t0 = now();
+      n = etris_rollout_run(ro, e, rollouts, depth, k + 1, results, ETRIS_MAX_PLACEMENTS);
+      t += now() - t0;
+
+      if (n <= 0)
+	n = 0;
+      if (mismatches == NULL)
+	memcpy(&expected[k * ETRIS_MAX_PLACEMENTS], results, n * sizeof(results[0]));
+      else if (!same(&expected[k * ETRIS_MAX_PLACEMENTS], results, n))
+	(*mismatches)++;
+    }
+    etris_destroy(e);
+  }
+
+  return t;
+}
+
+int main(int argc, char **argv)
+{
+  struct etris_rollout_result *expected;
+  struct game *games;
+  unsigned long probes, hits;
+  double t_plain, t_cold, t_warm;
+  int g, positions = 0, mismatches = 0;
+  ETRIS_ROLLOUT ro;
+  ETRIS_TT tt;
+  ETRIS e;
+  int n_games = argc > 1 ? atoi(argv[1]) : DEFAULT_GAMES;
+  int rollouts = argc > 2 ? atoi(argv[2]) : DEFAULT_ROLLOUTS;
+  int depth = argc > 3 ? atoi(argv[3]) : DEFAULT_DEPTH;
+  int threads = argc > 4 ? atoi(argv[4]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n_games < 1 || rollouts < 1 || depth < 0 || threads < 1) {
+    printf("usage: %s [games] [rollouts] [depth] [threads]\n", argv[0]);
+    return 1;
+  }
+
+  if ((games = malloc(n_games * sizeof(struct game))) == NULL ||
+      (expected = malloc(n_games * SAMPLES * ETRIS_MAX_PLACEMENTS * 
+			 sizeof(struct etris_rollout_result))) == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  /* record the corpus */
+  for (g = 0; g < n_games; g++) {
+    if ((e = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL)) == NULL) {
+      printf("Failed to create etris instance\n");
+      return 1;
+    }
+    etris_set_sequence(e, ETRIS_SEQUENCE_BAG, g);
+    etris_reset(e);
+    etris_record(e, games[g].log, LOG_MAX);
+    play(e, &games[g], g + 1);
+    if (etris_record_length(e, &games[g].length) != ETRIS_OK) {
+      printf("Game %d does not fit in %d bytes\n", g, LOG_MAX);
+      return 1;
+    }
+    positions += games[g].n;
+    etris_destroy(e);
+  }
+
+  if ((ro = etris_rollout_create(threads)) == NULL || 
+      (tt = etris_tt_create(TT_ENTRIES)) == NULL) {
+    printf("Failed to create rollout engine\n");
+    return 1;
+  }
+
+  t_plain = search(ro, games, n_games, rollouts, depth, expected, NULL);
+
+  /* table shared by all workers and kept from one position to the next */
+  etris_rollout_set_table(ro, tt);
+  t_cold = search(ro, games, n_games, rollouts, depth, expected, &mismatches);
+  etris_rollout_table_stats(ro, &probes, &hits);
+
+  /* searching the corpus again, as a bot revisiting positions would */
+  t_warm = search(ro, games, n_games, rollouts, depth, expected, &mismatches);
+
+  printf("games %d, positions %d, %d rollouts of %d figures, %d threads\n", 
+	 n_games, positions, rollouts, depth, threads);
+  printf("without table   %8.3f s\n", t_plain);
+  printf("with table      %8.3f s, %.2fx, %lu probes, %.1f%% hits\n", 
+	 t_cold, t_plain / t_cold, probes, probes ? 100.0 * hits / probes : 0.0);
+  etris_rollout_table_stats(ro, &probes, &hits);
+  printf("searched again  %8.3f s, %.2fx, %lu probes, %.1f%% hits overall\n", 
+	 t_warm, t_plain / t_warm, probes, probes ? 100.0 * hits / probes : 0.0);
+  printf("%d of %d positions searched differently with table\n", 
+	 mismatches, 2 * positions);
+
+  etris_rollout_destroy(ro);
+  etris_tt_destroy(tt);
+  free(expected);
+  free(games);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,321 @@
+/* etris-bench.c -- headless benchmark of the etris engine, reports results
+ * as JSON.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <time.h>
+
+/* built together with the engine to be able to set up line clears */
+#include "etris.c"
+
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS "unknown"
+#endif
+
+/* format version of the JSON output, bump when changing it */
+#define BENCH_FORMAT 1
+
+/* calls per timed block, amortizes the clock overhead */
+#define BLOCK 8
+
+struct field {
+  int width;
+  int height;
+  int border;
+};
+
+static struct field fields[] = {
+  {10, 20, 1},
+  {6, 12, 0},
+  {20, 40, 2},
+  {10, 200, 1}
+};
+
+#define NUMBER_OF_FIELDS (sizeof(fields) / sizeof(struct field))
+
+static unsigned int seed;
+static long scale = 1;
+static int first_result = 1;
+
+static void draw_block(int x, int y, int c)
+{
+}
+
+static void update_score(int score, int lines, int figures)
+{
+}
+
+static unsigned int xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static long long now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void result(struct field *f, const char *name, long ops, long long ns)
+{
+  printf("%s    {\"field\": \"%dx%d+%d\", \"case\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.1f}", 
+	 first_result ? "" : ",\n", f->width, f->height, f->border, name, ops, 
+	 ops > 0 ? (double)ns / ops : 0.0);
+  first_result = 0;
+}
+
+static ETRIS create(struct field *f)
+{
+  ETRIS e = etris_create(f->width, f->height, f->border, draw_block, update_score);
+
+  if (e == NULL) {
+    fprintf(stderr, "Failed to create etris instance\n");
+    exit(1);
+  }
+  seed = 2463534242u;
+  return e;
+}
+
+/* Ticks only, figures fall straight down until game over. */
+static void bench_tick(struct field *f)
+{
+  ETRIS e = create(f);
+  long i, n = 2000000 * scale;
+  long long t = now_ns();
+
+  for (i = 0; i < n; i++)
+    if (etris_tick(e) == ETRIS_GAME_OVER)
+      etris_reset(e);
+  result(f, "tick", n, now_ns() - t);
+  etris_destroy(e);
+}
+
+/* Blocks of random moves, each followed by an untimed tick. */
+static void bench_move(struct field *f)
+{
+  ETRIS e = create(f);
+  long i, n = 200000 * scale;
+  long long t, ns = 0;
+  int j;
+
+  for (i = 0; i < n; i++) {
+    t = now_ns();
+    for (j = 0; j < BLOCK; j++) {
+      switch (xorshift() % 3) {
+      case 0:
+	etris_left(e);
+	break;
+      case 1:
+	etris_right(e);
+	break;
+      default:
+	etris_rotate(e);
+	break;
+      }
+    }
+    ns += now_ns() - t;
+    if (etris_tick(e) == ETRIS_GAME_OVER)
+      etris_reset(e);
+  }
+  result(f, "move", n * BLOCK, ns);
+  etris_destroy(e);
+}
+
+/* Play input sequence, either random or a fixed script, with ticks in
+ * between. Reports time per call of any kind. */
+static void bench_play(struct field *f, int scripted)
+{
+  static const char script[] = "rllldttttrrrrdtttttlldtttttrrdtttt";
+  ETRIS e = create(f);
+  long i, n = 2000000 * scale;
+  long long t = now_ns();
+  int rc, in;
+
+  for (i = 0; i < n; i++) {
+    in = scripted ? script[i % (sizeof(script) - 1)] : "lrrdtttttttttttt"[xorshift() % 16];
+    switch (in) {
+    case 'l':
+      rc = etris_left(e);
+      break;
+    case 'r':
+      rc = etris_right(e);
+      break;
+    case 'd':
+      rc = etris_drop(e);
+      break;
+    default:
+      rc = etris_tick(e);
+      break;
+    }
+    if (rc == ETRIS_GAME_OVER)
+      etris_reset(e);
+  }
+  result(f, scripted ? "play_scripted" : "play_random", n, now_ns() - t);
+  etris_destroy(e);
+}
+
+/* Set up `lines' complete lines at the bottom below some rubble, as 
+ * when about to remove them. */
+static void setup_lines(ETRIS e, int lines)
+{
+  int x, y, l;
+
+  etris_reset(e);
+  for (y = e->field.height / 2; y < e->field.height; y++) {
+    for (x = e->field.border; x < e->field.width + e->field.border; x++) {
+      if ((x + y) % 3 == 0) {
+	E_CELL(e, x, y) = 3;
+	e->field.rows[y] |= (e_row)1 << x;
+      }
+    }
+  }
+  for (l = 0; l < lines; l++) {
+    y = e->field.height - lines + l;
+    for (x = e->field.border; x < e->field.width + e->field.border; x++)
+      E_CELL(e, x, y) = ETRIS_BLOCK_BACKGROUND;
+    e->field.rows[y] = E_ROW_FULL;
+    e->field.lines[l] = y;
+  }
+  e_scan_well(e);
+  e->state = E_SHOWING_BLANK;
+  e->ticks = 1;
+}
+
+/* Time the tick removing complete lines and redrawing the field. */
+static void bench_line_clear(struct field *f, int lines)
+{
+  ETRIS e = create(f);
+  long i, n = 20000 * scale;
+  long long t, ns = 0;
+
+  for (i = 0; i < n; i++) {
+    setup_lines(e, lines);
+    t = now_ns();
+    etris_tick(e);
+    ns += now_ns() - t;
+  }
+  result(f, lines == 1 ? "line_clear_1" : "line_clear_4", n, ns);
+  etris_destroy(e);
+}
+
+/* Search and evaluate all placements, on fields filled by random play. */
+static void bench_best_move(struct field *f)
+{
+  ETRIS e = create(f);
+  struct etris_placement best;
+  long i, n = 20000 * scale;
+  long long t, ns = 0;
+  int j;
+
+  for (i = 0; i < n; i++) {
+    t = now_ns();
+    etris_best_move(e, &best);
+    ns += now_ns() - t;
+    for (j = 0; j < 16; j++) {
+      if (xorshift() % 4 == 0)
+	etris_left(e);
+      if (etris_tick(e) == ETRIS_GAME_OVER)
+	etris_reset(e);
+    }
+  }
+  result(f, "best_move", n, ns);
+  etris_destroy(e);
+}
+
+/* Save and restore game state, as done by search and rollback. */
+static void bench_snapshot(struct field *f)
+{
+  ETRIS e = create(f);
+  long i, n = 1000000 * scale;
+  long long t;
+  void *state = malloc(etris_snapshot_size(e));
+
+  if (state == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  t = now_ns();
+  for (i = 0; i < n; i++) {
+    etris_snapshot(e, state);
+    etris_restore(e, state);
+  }
+  result(f, "snapshot_restore", n, now_ns() - t);
+  free(state);
+  etris_destroy(e);
+}
+
+static void bench_redraw(struct field *f)
+{
+  ETRIS e = create(f);
+  long i, n = 20000 * scale;
+  long long t = now_ns();
+
+  for (i = 0; i < n; i++)
+    etris_redraw(e);
+  result(f, "redraw", n, now_ns() - t);
+  etris_destroy(e);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int i;
+
+  if (argc > 1 && (scale = atol(argv[1])) < 1) {
+    fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+    return 1;
+  }
+
+  printf("{\n  \"format\": %d,\n  \"cflags\": \"%s\",\n  \"scale\": %ld,\n  \"results\": [\n", 
+	 BENCH_FORMAT, BENCH_CFLAGS, scale);
+
+  for (i = 0; i < NUMBER_OF_FIELDS; i++) {
+    bench_tick(&fields[i]);
+    bench_move(&fields[i]);
+    bench_play(&fields[i], 0);
+    bench_play(&fields[i], 1);
+    bench_line_clear(&fields[i], 1);
+    bench_line_clear(&fields[i], 4);
+    bench_redraw(&fields[i]);
+    bench_best_move(&fields[i]);
+    bench_snapshot(&fields[i]);
+  }
+
+  printf("\n  ]\n}\n");
+
+  return 0;
+}
@@ -0,0 +1,534 @@
+/* etris-check.c -- checks of engine behavior that is easy to break.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+/* built together with the engine to be able to look inside */
+#include "etris.c"
+
+static int failures;
+
+#define CHECK(cond, what) \
+  do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, what); failures++; } } while (0)
+
+/* Play step `i' of a game steered towards etris_best_move(), ticking every
+ * other step, so that figures move, lock and lines are removed. Games that
+ * are over start again. */
+static void play_step(ETRIS e, int i)
+{
+  struct etris_placement best;
+  int x, y, r;
+
+  if (i % 2)
+    etris_tick(e);
+  else if (etris_best_move(e, &best) == ETRIS_OK && 
+	   etris_ghost_position(e, &x, &y, &r) == ETRIS_OK) {
+    if (r != best.r)
+      etris_rotate(e);
+    else if (x != best.x)
+      x < best.x ? etris_right(e) : etris_left(e);
+    else
+      etris_hard_drop(e);
+  }
+  if (etris_deadline(e) < 0)
+    etris_reset(e);
+}
+
+/* The figure table as it was written down before it was expanded at compile
+ * time: block offset, color and four rotations of nibble packed blocks. */
+static const struct {
+  char offset;
+  char color;
+  char blocks[4][4];
+} literal_figures[] = {
+  {0x00, 3, {{0x20, 0x21, 0x22, 0x23}, {0x01, 0x11, 0x21, 0x31}, {0x20, 0x21, 0x22, 0x23}, {0x01, 0x11, 0x21, 0x31}}},
+  {0x00, 4, {{0x11, 0x12, 0x22, 0x23}, {0x11, 0x21, 0x02, 0x12}, {0x11, 0x12, 0x22, 0x23}, {0x11, 0x21, 0x02, 0x12}}},
+  {0x00, 5, {{0x21, 0x12, 0x22, 0x13}, {0x11, 0x21, 0x22, 0x32}, {0x21, 0x12, 0x22, 0x13}, {0x11, 0x21, 0x22, 0x32}}},
+  {0x00, 6, {{0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}}},
+  {0x01, 7, {{0x21, 0x12, 0x22, 0x32}, {0x21, 0x22, 0x32, 0x23}, {0x12, 0x22, 0x32, 0x23}, {0x21, 0x12, 0x22, 0x23}}},
+  {0x00, 8, {{0x21, 0x22, 0x23, 0x13}, {0x11, 0x12, 0x22, 0x32}, {0x21, 0x31, 0x22, 0x23}, {0x12, 0x22, 0x32, 0x33}}},
+  {0x00, 9, {{0x21, 0x22, 0x23, 0x33}, {0x12, 0x22, 0x32, 0x13}, {0x11, 0x21, 0x22, 0x23}, {0x31, 0x12, 0x22, 0x32}}}
+};
+
+/* Every rotation expanded by E_FIGURE matches the literal table, block by 
+ * block and row mask by row mask. */
+static void check_figure_table(void)
+{
+  int n, r, i, y, bx, by;
+  unsigned char rows[4];
+  const e_rotation *rot;
+
+  CHECK(E_NUMBER_OF_FIGURES == sizeof(literal_figures) / sizeof(literal_figures[0]),
+	"number of figures");
+  for (n = 0; n < (int)E_NUMBER_OF_FIGURES; n++) {
+    CHECK(figures[n].offset_x == ((literal_figures[n].offset >> 4) & 0xf), "figure x offset");
+    CHECK(figures[n].offset_y == (literal_figures[n].offset & 0xf), "figure y offset");
+    CHECK(figures[n].color == literal_figures[n].color, "figure color");
+    for (r = 0; r < 4; r++) {
+      rot = &figures[n].rotations[r];
+      memset(rows, 0, sizeof(rows));
+      for (i = 0; i < 4; i++) {
+	bx = (literal_figures[n].blocks[r][i] >> 4) & 0xf;
+	by = literal_figures[n].blocks[r][i] & 0xf;
+	CHECK(rot->x[i] == bx, "block x");
+	CHECK(rot->y[i] == by, "block y");
+	rows[by] |= 1 << bx;
+      }
+      for (y = 0; y < 4; y++)
+	CHECK(rot->rows[y] == rows[y], "row mask");
+    }
+  }
+}
+
+/* A pooled game ended by input, not by a tick, is recycled by the next 
+ * pool tick like any other. */
+static void check_pool_input_game_over(void)
+{
+  ETRIS_POOL p = etris_pool_create(4, 10, 20, 1, NULL, NULL);
+  ETRIS e = etris_pool_get(p, 2);
+  int i, rc = ETRIS_OK;
+
+  for (i = 0; i < 1000 && rc != ETRIS_GAME_OVER; i++)
+    rc = etris_hard_drop(e);
+  CHECK(rc == ETRIS_GAME_OVER, "hard drops end the game");
+  CHECK(etris_deadline(e) < 0, "game is over after hard drops");
+
+  CHECK(etris_pool_tick(p) == 1, "next pool tick recycles the game");
+  CHECK(etris_deadline(e) > 0, "recycled game is played again");
+
+  etris_pool_destroy(p);
+}
+
+/* Advancing a game that is over keeps reporting that it is over. */
+static void check_advance_game_over(void)
+{
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+  int i, rc = ETRIS_OK;
+
+  for (i = 0; i < 1000 && rc != ETRIS_GAME_OVER; i++)
+    rc = etris_hard_drop(e);
+  CHECK(rc == ETRIS_GAME_OVER, "hard drops end the game");
+  CHECK(etris_advance(e, 1) == ETRIS_GAME_OVER, "advance reports game over");
+  CHECK(etris_advance(e, 10000) == ETRIS_GAME_OVER, "and keeps doing so");
+
+  etris_destroy(e);
+}
+
+/* Placing figures outside the field is refused, whatever the distance. */
+static void check_place_out_of_range(void)
+{
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+  static const int xs[] = {-1000, -4, 12, 40, E_ROW_BITS, 1000};
+  int i, r;
+
+  for (i = 0; i < (int)(sizeof(xs) / sizeof(xs[0])); i++)
+    for (r = 0; r < 4; r++)
+      CHECK(etris_place(e, xs[i], r) == ETRIS_ERR, "place outside the field");
+  CHECK(etris_place(e, 4, 0) == ETRIS_OK_REDRAW, "place inside the field");
+
+  etris_destroy(e);
+}
+
+/* Store token of `op' and `arg' as the input log does, returns its length. */
+static size_t put_token(unsigned char *p, int op, uint64_t arg)
+{
+  uint64_t v = arg << E_LOG_OP_BITS | op;
+  size_t n = 0;
+
+  for (; v >= 0x80; v >>= 7)
+    p[n++] = (unsigned char)(v | 0x80);
+  p[n++] = (unsigned char)v;
+  return n;
+}
+
+/* Crafted logs are refused quickly, without writing outside the field. */
+static void check_replay_malformed(void)
+{
+  static const unsigned char place_far[] = {0x86, 0x0b};
+  static const unsigned char truncated[] = {0x85, 0x80};
+  unsigned char log[32];
+  size_t n;
+  clock_t t;
+  int i;
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+
+  CHECK(etris_replay(e, place_far, sizeof(place_far)) == ETRIS_ERR, "placement far right");
+  etris_reset(e);
+  n = put_token(log, E_LOG_PLACE, (uint64_t)-1 >> E_LOG_OP_BITS);
+  CHECK(etris_replay(e, log, n) == ETRIS_ERR, "placement beyond int range");
+  etris_reset(e);
+  CHECK(etris_replay(e, truncated, sizeof(truncated)) == ETRIS_ERR, "truncated token");
+  etris_reset(e);
+  n = put_token(log, E_LEFT, (uint64_t)1 << 58);
+  CHECK(etris_replay(e, log, n) == ETRIS_ERR, "endless run of moves");
+  etris_reset(e);
+  n = put_token(log, E_DROP, E_LOG_RUN_MAX + 1);
+  CHECK(etris_replay(e, log, n) == ETRIS_ERR, "run of drops too long");
+  etris_reset(e);
+  for (n = 0, i = 0; i < 3; i++)
+    n += put_token(log + n, E_TICK, (uint64_t)1 << 60);
+  t = clock();
+  CHECK(etris_replay(e, log, n) == ETRIS_GAME_OVER, "endless runs of ticks end the game");
+  CHECK(clock() - t < CLOCKS_PER_SEC / 10, "endless runs of ticks replay quickly");
+
+  etris_destroy(e);
+}
+
+/* Runs longer than a token holds are recorded in several tokens and 
+ * replay to the same game. */
+static void check_record_long_run(void)
+{
+  unsigned char log[64];
+  size_t length;
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+  ETRIS f = etris_create(10, 20, 1, NULL, NULL);
+  int i;
+
+  etris_record(e, log, sizeof(log));
+  for (i = 0; i < 3 * E_LOG_RUN_MAX; i++)
+    etris_left(e);
+  etris_drop(e);
+  CHECK(etris_record_length(e, &length) == ETRIS_OK, "long run fits log");
+  CHECK(etris_replay(f, log, length) == ETRIS_OK, "long run replays");
+  CHECK(etris_hash(e) == etris_hash(f), "long run replays to the same game");
+
+  etris_destroy(e);
+  etris_destroy(f);
+}
+
+/* Snapshots restore as they were taken, corrupt ones are refused and 
+ * leave the instance alone. */
+static void check_restore_checked(void)
+{
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+  size_t size = etris_snapshot_size(e);
+  unsigned char *good = malloc(size), *bad = malloc(size);
+  struct e_etris t;
+  uint64_t hash;
+  int i, refused, score, lines, figures;
+  ETRIS f;
+
+  for (i = 0; i < 12; i++)
+    etris_place(e, 1 + i % 8, i % 4);
+  etris_snapshot(e, good);
+  hash = etris_hash(e);
+  etris_reset(e);
+  CHECK(etris_restore_checked(e, good) == ETRIS_OK, "snapshot checks out");
+  CHECK(etris_hash(e) == hash, "checked restore brings the game back");
+
+  /* figure out of range */
+  memcpy(bad, good, size);
+  memcpy((char *)&t + E_STATE_OFFSET, bad, sizeof(t) - E_STATE_OFFSET);
+  t.figure.n = 200;
+  memcpy(bad, (char *)&t + E_STATE_OFFSET, sizeof(t) - E_STATE_OFFSET);
+  CHECK(etris_restore_checked(e, bad) == ETRIS_ERR, "figure out of range");
+  CHECK(etris_hash(e) == hash, "refused snapshot leaves game alone");
+
+  /* figure far outside the field */
+  memcpy((char *)&t + E_STATE_OFFSET, good, sizeof(t) - E_STATE_OFFSET);
+  t.figure.x = 40;
+  memcpy(bad, (char *)&t + E_STATE_OFFSET, sizeof(t) - E_STATE_OFFSET);
+  CHECK(etris_restore_checked(e, bad) == ETRIS_ERR, "figure outside the field");
+
+  /* line to remove out of the field */
+  memcpy((char *)&t + E_STATE_OFFSET, good, sizeof(t) - E_STATE_OFFSET);
+  t.field.lines[0] = 1000;
+  memcpy(bad, (char *)&t + E_STATE_OFFSET, sizeof(t) - E_STATE_OFFSET);
+  CHECK(etris_restore_checked(e, bad) == ETRIS_ERR, "line out of the field");
+
+  /* wall knocked out of a row */
+  memcpy(bad, good, size);
+  memset(bad + E_ROWS_OFFSET - E_STATE_OFFSET, 0, sizeof(e_row));
+  CHECK(etris_restore_checked(e, bad) == ETRIS_ERR, "row without walls");
+
+  /* snapshots taken at any point of play, lines being removed included,
+   * check out */
+  f = etris_create(10, 20, 1, NULL, NULL);
+  etris_reset(e);
+  for (i = 0, refused = 0; i < 20000; i++) {
+    play_step(e, i);
+    etris_snapshot(e, good);
+    refused += etris_restore_checked(f, good) != ETRIS_OK;
+  }
+  etris_score(e, &score, &lines, &figures);
+  CHECK(lines > 0, "play removes lines");
+  CHECK(refused == 0, "snapshots of play check out");
+
+  free(good);
+  free(bad);
+  etris_destroy(e);
+  etris_destroy(f);
+}
+
+/* Start game of bag sequence `seed' on a new instance. */
+static ETRIS start_game(unsigned int seed)
+{
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+
+  etris_set_sequence(e, ETRIS_SEQUENCE_BAG, seed);
+  etris_reset(e);
+  return e;
+}
+
+/* A game restored from a snapshot, or cloned, plays on exactly as the
+ * game it was taken from. */
+static void check_snapshot_round_trip(void)
+{
+  ETRIS e = start_game(12), c;
+  size_t size = etris_snapshot_size(e);
+  unsigned char *saved = malloc(size), *a = malloc(size), *b = malloc(size);
+  int i;
+
+  for (i = 0; i < 1001; i++)
+    play_step(e, i);
+
+  etris_snapshot(e, saved);
+  c = etris_clone(e);
+  for (i = 1001; i < 3001; i++) {
+    play_step(e, i);
+    play_step(c, i);
+  }
+  etris_snapshot(e, a);
+  etris_snapshot(c, b);
+  CHECK(memcmp(a, b, size) == 0, "clone plays on as the original");
+
+  etris_restore(e, saved);
+  etris_snapshot(e, b);
+  CHECK(memcmp(saved, b, size) == 0, "restore brings back the snapshot");
+  for (i = 1001; i < 3001; i++)
+    play_step(e, i);
+  etris_snapshot(e, b);
+  CHECK(memcmp(a, b, size) == 0, "restored game plays on as the original");
+
+  free(saved);
+  free(a);
+  free(b);
+  etris_destroy(c);
+  etris_destroy(e);
+}
+
+/* A recorded game replays to the very same state, in one go or tick by 
+ * tick range. */
+static void check_replay_deterministic(void)
+{
+  static unsigned char log[1 << 16];
+  struct etris_replay_pos pos = {0, 0, 0};
+  ETRIS e = start_game(3), f = start_game(3), g = start_game(3);
+  size_t length, size = etris_snapshot_size(e);
+  unsigned char *a = malloc(size), *b = malloc(size);
+  unsigned long ticks;
+  int i, rc;
+
+  etris_record(e, log, sizeof(log));
+  for (i = 0; i < 6000; i++)
+    play_step(e, i);
+  CHECK(etris_record_length(e, &length) == ETRIS_OK, "game fits log");
+  etris_snapshot(e, a);
+
+  CHECK(etris_replay(f, log, length) == ETRIS_OK, "log replays");
+  etris_snapshot(f, b);
+  CHECK(memcmp(a, b, size) == 0, "replay ends in the recorded state");
+
+  for (ticks = 100, rc = ETRIS_OK; pos.offset < length && rc == ETRIS_OK; ticks += 100)
+    rc = etris_replay_to(g, log, length, &pos, ticks);
+  CHECK(rc == ETRIS_OK, "log replays in ranges of ticks");
+  etris_snapshot(g, b);
+  CHECK(memcmp(a, b, size) == 0, "replay in ranges ends in the recorded state");
+
+  free(a);
+  free(b);
+  etris_destroy(e);
+  etris_destroy(f);
+  etris_destroy(g);
+}
+
+/* The position hash, column tops and holes kept up to date while playing
+ * match those found by scanning the field from scratch. */
+static void check_hash_rescan(void)
+{
+  ETRIS e = start_game(7), c = start_game(7);
+  unsigned char *buffer = malloc(etris_snapshot_size(e));
+  int i, differ = 0, lines, score, figures;
+
+  for (i = 0; i < 20000; i++) {
+    play_step(e, i);
+    etris_snapshot(e, buffer);
+    etris_restore(c, buffer);
+    e_scan_well(c);
+    if (etris_hash(c) != etris_hash(e) || c->well.top_row != e->well.top_row ||
+	memcmp(c->well.top, e->well.top, sizeof(e->well.top)) != 0 ||
+	memcmp(c->well.holes, e->well.holes, sizeof(e->well.holes)) != 0)
+      differ++;
+  }
+  etris_score(e, &score, &lines, &figures);
+  CHECK(lines > 0, "play removes lines");
+  CHECK(differ == 0, "kept hash, tops and holes match a rescan");
+
+  free(buffer);
+  etris_destroy(e);
+  etris_destroy(c);
+}
+
+/* Removing lines that are not next to each other moves every other row
+ * down by the lines below it, as removing them one by one would. */
+static void check_remove_lines(void)
+{
+  static const int full[] = {14, 16, 17};
+  ETRIS e = etris_create(10, 20, 1, NULL, NULL);
+  int height = e->field.height, stride = e->field.stride;
+  e_row *rows = malloc(height * sizeof(e_row));
+  char *colors = malloc(height * stride);
+  short top[E_ROW_BITS], holes[E_ROW_BITS];
+  uint64_t hash;
+  int i, x, y, to, first, last, top_row;
+
+  /* a pattern of blocks in the bottom half, some rows complete */
+  for (y = height / 2; y < height; y++) {
+    for (x = 0; x < e->field.width; x++) {
+      if (y == 14 || y == 16 || y == 17 || y == 19 || (x * 7 + y * 3) % 5 < 2) {
+	e->field.rows[y] |= (e_row)1 << (x + e->field.border);
+	E_CELL(e, x + e->field.border, y) = 3 + (x + y) % 7;
+      }
+    }
+  }
+  e_scan_well(e);
+  top_row = e->well.top_row;
+
+  /* the same done row by row, lines to remove skipped from the bottom up */
+  for (y = to = height - 1; y >= 0; y--) {
+    for (i = 0; i < 3 && full[i] != y; i++)
+      ;
+    if (i < 3)
+      continue;
+    rows[to] = e->field.rows[y];
+    memcpy(colors + to * stride, &E_CELL(e, 0, y), stride);
+    to--;
+  }
+  for (; to >= 0; to--) {
+    rows[to] = e->field.walls;
+    memcpy(colors + to * stride, &E_CELL(e, 0, 0), stride);
+  }
+
+  /* the lines a figure locked at rows 14 to 17 completes, row 19 is not
+   * one of them */
+  CHECK(e_check_lines(e, 14) == 3, "three complete lines found");
+  first = e_remove_lines(e, &last);
+  CHECK(first == top_row, "first row moved is the highest taken");
+  CHECK(last == 17, "last row moved");
+  CHECK(memcmp(rows, e->field.rows, height * sizeof(e_row)) == 0, "rows after removal");
+  CHECK(memcmp(colors, e->field.data, height * stride) == 0, "colors after removal");
+
+  memcpy(top, e->well.top, sizeof(top));
+  memcpy(holes, e->well.holes, sizeof(holes));
+  hash = e->well.hash;
+  e_scan_well(e);
+  CHECK(memcmp(top, e->well.top, sizeof(top)) == 0, "column tops after removal");
+  CHECK(memcmp(holes, e->well.holes, sizeof(holes)) == 0, "holes after removal");
+  CHECK(hash == e->well.hash, "hash after removal");
+
+  free(rows);
+  free(colors);
+  etris_destroy(e);
+}
+
+/* Environments of equal seed step through the same games, and a game 
+ * whose action is not valid is done. */
+static void check_env_deterministic(void)
+{
+  enum { GAMES = 8, STEPS = 300 };
+  ETRIS_ENV a = etris_env_create(GAMES, 10, 20, 5), b = etris_env_create(GAMES, 10, 20, 5);
+  int n = etris_env_actions(a), actions[GAMES];
+  size_t size = GAMES * etris_env_observation_size(a);
+  unsigned char *obs_a = malloc(size), *obs_b = malloc(size), *masks = malloc(GAMES * n);
+  unsigned char done_a[GAMES], done_b[GAMES];
+  float reward_a[GAMES], reward_b[GAMES];
+  unsigned x = 1;
+  int g, i, j, differ = 0, dones = 0;
+
+  etris_env_observe(a, obs_a);
+  etris_env_observe(b, obs_b);
+  CHECK(memcmp(obs_a, obs_b, size) == 0, "environments start alike");
+
+  for (i = 0; i < STEPS; i++) {
+    etris_env_masks(a, masks);
+    for (g = 0; g < GAMES; g++) {
+      x = x * 1103515245u + 12345u;
+      for (j = (x >> 16) % n; !masks[g * n + j]; j = (j + 1) % n)
+	;
+      actions[g] = j;
+    }
+    etris_env_step(a, actions, obs_a, reward_a, done_a);
+    etris_env_step(b, actions, obs_b, reward_b, done_b);
+    if (memcmp(obs_a, obs_b, size) != 0 || memcmp(done_a, done_b, GAMES) != 0 ||
+	memcmp(reward_a, reward_b, sizeof(reward_a)) != 0)
+      differ++;
+    for (g = 0; g < GAMES; g++)
+      dones += done_a[g];
+  }
+  CHECK(differ == 0, "environments of equal seed step alike");
+  CHECK(dones > 0, "random games end");
+
+  /* the last action puts most figures partly off the field */
+  for (g = 0; g < GAMES; g++)
+    actions[g] = n - 1;
+  etris_env_masks(a, masks);
+  etris_env_step(a, actions, obs_a, reward_a, done_a);
+  for (g = 0; g < GAMES; g++)
+    CHECK(masks[g * n + n - 1] || done_a[g], "game with invalid action is done");
+
+  free(obs_a);
+  free(obs_b);
+  free(masks);
+  etris_env_destroy(a);
+  etris_env_destroy(b);
+}
+
+int main(void)
+{
+  check_figure_table();
+  check_pool_input_game_over();
+  check_advance_game_over();
+  check_place_out_of_range();
+  check_replay_malformed();
+  check_record_long_run();
+  check_restore_checked();
+  check_snapshot_round_trip();
+  check_replay_deterministic();
+  check_hash_rescan();
+  check_remove_lines();
+  check_env_deterministic();
+
+  if (failures)
+    printf("%d checks failed\n", failures);
+  else
+    printf("all checks passed\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+/* etris-loadgen.c -- load generator for etris-server, synthetic players feed
+ * input to many games while the server ticks them at 100 Hz.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "etris.h"
+#include "etris-server.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define DEFAULT_GAMES 20000
+#define DEFAULT_SECONDS 3
+#define DEFAULT_PLAYERS 2
+
+/* inputs per game and second sent by synthetic players */
+#define INPUT_RATE 4
+
+#define TICK_NS 10000000L
+
+struct player {
+  pthread_t thread;
+  ETRIS_SERVER s;
+  int games;
+  int players;
+  unsigned seed;
+  unsigned long sent;
+  unsigned long rejected;
+};
+
+/* set by the main thread to end player threads */
+static int stop;
+
+static unsigned xorshift(unsigned *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+static long long now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Send a burst of random input every millisecond. */
+static void *player_main(void *arg)
+{
+  struct player *p = arg;
+  struct timespec ms = {0, 1000000L};
+  int i, burst = p->games * INPUT_RATE / 1000 / p->players + 1;
+  unsigned r;
+
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    for (i = 0; i < burst; i++) {
+      r = xorshift(&p->seed);
+      if (etris_server_input(p->s, r % p->games, 1 + (r >> 24) % ETRIS_SERVER_HARD_DROP) == ETRIS_OK)
+	p->sent++;
+      else
+	p->rejected++;
+    }
+    nanosleep(&ms, NULL);
+  }
+
+  return NULL;
+}
+
+static int compare(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+static void run(int games, int threads, int players, int seconds)
+{
+  ETRIS_SERVER s;
+  struct player *p;
+  struct etris_stats stats;
+  struct timespec next;
+  char text[2048];
+  long long *lat, t, busy = 0;
+  unsigned long sent = 0, rejected = 0;
+  int i, steps = seconds * 100, recycled = 0;
+
+  if ((s = etris_server_create(games, threads, FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER)) == NULL ||
+      (p = calloc(sizeof(struct player), players)) == NULL ||
+      (lat = malloc(steps * sizeof(long long))) == NULL) {
+    printf("Failed to create etris server\n");
+    exit(1);
+  }
+
+  __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+  for (i = 0; i < players; i++) {
+    p[i].s = s;
+    p[i].games = games;
+    p[i].players = players;
+    p[i].seed = 2463534242u + i;
+    pthread_create(&p[i].thread, NULL, player_main, &p[i]);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (i = 0; i < steps; i++) {
+    t = now_ns();
+    recycled += etris_server_step(s);
+    lat[i] = now_ns() - t;
+    busy += lat[i];
+
+    /* pace at 100 Hz from a fixed time base, no sleep when behind */
+    next.tv_nsec += TICK_NS;
+    if (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  for (i = 0; i < players; i++) {
+    pthread_join(p[i].thread, NULL);
+    sent += p[i].sent;
+    rejected += p[i].rejected;
+  }
+
+  qsort(lat, steps, sizeof(long long), compare);
+  printf("%7d %8d %10.1f %10.1f %12.0f %10lu %8lu %8lu %8d\n", 
+	 threads, games, lat[steps / 2] / 1e3, lat[steps * 99 / 100] / 1e3,
+	 (double)games * TICK_NS / ((double)busy / steps * threads),
+	 etris_server_steals(s), sent, rejected, recycled);
+
+  /* engine instrumentation, if the library is built with ETRIS_STATS */
+  if (etris_server_stats(s, &stats) == ETRIS_OK) {
+    etris_stats_format(&stats, text, sizeof(text));
+    fputs(text, stdout);
+  }
+
+  etris_server_destroy(s);
+  free(lat);
+  free(p);
+}
+
+int main(int argc, char **argv)
+{
+  int games = argc > 1 ? atoi(argv[1]) : DEFAULT_GAMES;
+  int seconds = argc > 2 ? atoi(argv[2]) : DEFAULT_SECONDS;
+  int threads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int players = argc > 4 ? atoi(argv[4]) : DEFAULT_PLAYERS;
+  int t;
+
+  if (games < 1 || seconds < 1 || threads < 1 || players < 1) {
+    printf("usage: %s [games] [seconds] [max threads] [player threads]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%7s %8s %10s %10s %12s %10s %8s %8s %8s\n", "threads", "games", 
+	 "p50 us", "p99 us", "games/core", "steals", "inputs", "rejected", "recycled");
+
+  for (t = 1; t < threads; t *= 2)
+    run(games, t, players, seconds);
+  run(games, threads, players, seconds);
+
+  return 0;
+}
@@ -0,0 +1,371 @@
+/* etris-rollout.c -- Monte Carlo rollouts of etris games on a thread pool.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "etris.h"
+#include "etris-rollout.h"
+#include "etris-tt.h"
+
+/* rollouts per unit of work handed to workers */
+#define E_CHUNK 16
+
+/* chance in percent that a rollout places a figure at random */
+#define E_RANDOM_PERCENT 25
+
+/* Scratch memory of a worker, the instance rollouts are played on and the
+ * outcome per placement. Only touched by its worker while rolling out. */
+struct e_arena {
+  void *memory;
+  size_t size;
+  ETRIS e;
+  struct etris_placement placements[ETRIS_MAX_PLACEMENTS];
+  double score[ETRIS_MAX_PLACEMENTS];
+  double lines[ETRIS_MAX_PLACEMENTS];
+  int game_overs[ETRIS_MAX_PLACEMENTS];
+  /* table probes and hits since the table was set */
+  unsigned long probes;
+  unsigned long hits;
+};
+
+struct e_worker {
+  pthread_t thread;
+  ETRIS_ROLLOUT ro;
+  struct e_arena arena;
+};
+
+struct e_rollout {
+  int threads;
+  struct e_worker *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned generation;
+  unsigned finished;
+  int pending;
+  int quit;
+  ETRIS_TT tt;
+
+  /* current job */
+  void *state;
+  size_t state_size;
+  int width;
+  int height;
+  int border;
+  struct etris_placement candidates[ETRIS_MAX_PLACEMENTS];
+  int n;
+  int rollouts;
+  int depth;
+  int chunks;
+  unsigned int seed;
+  unsigned next;
+};
+
+/* Random number generator state for rollout `k' from placement `c', 
+ * independent of which worker plays it. */
+static unsigned int e_seed(unsigned int seed, int c, int k)
+{
+  unsigned int x = seed ^ (c * 0x9e3779b9u) ^ (k * 0x85ebca6bu);
+
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x ? x : 1;
+}
+
+static unsigned int e_random(unsigned int *x)
+{
+  *x ^= *x << 13;
+  *x ^= *x >> 17;
+  *x ^= *x << 5;
+  return *x;
+}
+
+/* Look up placement stored for position `key' in the table, counting 
+ * probes and hits of the worker. */
+static int e_probe(ETRIS_ROLLOUT ro, struct e_arena *a, uint64_t key, uint64_t *v)
+{
+  a->probes++;
+  if (!etris_tt_probe(ro->tt, key, v))
+    return 0;
+  a->hits++;
+  return 1;
+}
+
+/* Play rollout `k' from placement `c' on scratch instance. */
+static void e_rollout(ETRIS_ROLLOUT ro, struct e_arena *a, int c, int k)
+{
+  struct etris_placement *p = a->placements;
+  unsigned int x = e_seed(ro->seed, c, k);
+  int i, d, n, b, score, lines, figures, s0, l0;
+  uint64_t key = 0, v;
+
+  etris_restore(a->e, ro->state);
+  etris_seed(a->e, e_random(&x));
+  etris_score(a->e, &s0, &l0, &figures);
+
+  if (etris_place(a->e, ro->candidates[c].x, ro->candidates[c].r) == ETRIS_GAME_OVER) {
+    a->game_overs[c]++;
+  }
+  else {
+    for (d = 0; d < ro->depth; d++) {
+      if (e_random(&x) % 100 < E_RANDOM_PERCENT) {
+	if ((n = etris_placements(a->e, p, ETRIS_MAX_PLACEMENTS)) <= 0)
+	  break;
+	b = e_random(&x) % n;
+      }
+      else if (ro->tt && e_probe(ro, a, key = etris_hash(a->e), &v)) {
+	/* best placement only depends on the position, seen before */
+	b = 0;
+	p[b].x = (int)(v >> 2) - 64;
+	p[b].r = v & 3;
+      }
+      else {
+	if ((n = etris_placements(a->e, p, ETRIS_MAX_PLACEMENTS)) <= 0)
+	  break;
+	for (i = 1, b = 0; i < n; i++)
+	  if (p[i].score > p[b].score)
+	    b = i;
+	if (ro->tt)
+	  etris_tt_store(ro->tt, key, (uint64_t)(p[b].x + 64) << 2 | p[b].r);
+      }
+      if (etris_place(a->e, p[b].x, p[b].r) == ETRIS_GAME_OVER) {
+	a->game_overs[c]++;
+	break;
+      }
+    }
+  }
+
+  etris_score(a->e, &score, &lines, &figures);
+  a->score[c] += score - s0;
+  a->lines[c] += lines - l0;
+}
+
+static void e_work(ETRIS_ROLLOUT ro, struct e_arena *a)
+{
+  unsigned t;
+  int c, k, end;
+
+  a->e = etris_init_in(a->memory, ro->width, ro->height, ro->border, NULL, NULL);
+  memset(a->score, 0, ro->n * sizeof(double));
+  memset(a->lines, 0, ro->n * sizeof(double));
+  memset(a->game_overs, 0, ro->n * sizeof(int));
+
+  while ((t = __atomic_fetch_add(&ro->next, 1, __ATOMIC_RELAXED)) < 
+	 (unsigned)(ro->n * ro->chunks)) {
+    c = t / ro->chunks;
+    k = (t % ro->chunks) * E_CHUNK;
+    end = (k + E_CHUNK) < ro->rollouts ? (k + E_CHUNK) : ro->rollouts;
+    for (; k < end; k++)
+      e_rollout(ro, a, c, k);
+  }
+}
+
+static void *e_worker_main(void *arg)
+{
+  struct e_worker *w = arg;
+  ETRIS_ROLLOUT ro = w->ro;
+  unsigned seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&ro->lock);
+    while (ro->generation == seen && !ro->quit)
+      pthread_cond_wait(&ro->start, &ro->lock);
+    seen = ro->generation;
+    if (ro->quit) {
+      pthread_mutex_unlock(&ro->lock);
+      break;
+    }
+    pthread_mutex_unlock(&ro->lock);
+
+    e_work(ro, &w->arena);
+
+    pthread_mutex_lock(&ro->lock);
+    if (--ro->pending == 0) {
+      ro->finished = seen;
+      pthread_cond_signal(&ro->done);
+    }
+    pthread_mutex_unlock(&ro->lock);
+  }
+
+  return NULL;
+}
+
+/* Make sure `*memory' holds at least `size' bytes. */
+static int e_reserve(void **memory, size_t *capacity, size_t size)
+{
+  void *p;
+
+  if (*capacity >= size)
+    return ETRIS_OK;
+  if ((p = realloc(*memory, size)) == NULL)
+    return ETRIS_ERR_NOMEM;
+  *memory = p;
+  *capacity = size;
+  return ETRIS_OK;
+}
+
+int etris_rollout_run(ETRIS_ROLLOUT ro, ETRIS e, int rollouts, int depth, 
+		      unsigned int seed, struct etris_rollout_result *results, int max)
+{
+  int i, j, n;
+  double score, lines;
+
+  if (rollouts < 1 || depth < 0 || etris_has_generator(e) ||
+      (n = etris_placements(e, ro->candidates, ETRIS_MAX_PLACEMENTS)) <= 0)
+    return ETRIS_ERR;
+
+  etris_dimensions(e, &ro->width, &ro->height, &ro->border);
+  if (e_reserve(&ro->state, &ro->state_size, etris_snapshot_size(e)) != ETRIS_OK)
+    return ETRIS_ERR_NOMEM;
+  for (i = 0; i < ro->threads; i++)
+    if (e_reserve(&ro->workers[i].arena.memory, &ro->workers[i].arena.size, 
+		  etris_sizeof(ro->width, ro->height, ro->border)) != ETRIS_OK)
+      return ETRIS_ERR_NOMEM;
+
+  etris_snapshot(e, ro->state);
+  ro->n = n < max ? n : max;
+  ro->rollouts = rollouts;
+  ro->depth = depth;
+  ro->chunks = (rollouts + E_CHUNK - 1) / E_CHUNK;
+  ro->seed = seed;
+  ro->next = 0;
+
+  pthread_mutex_lock(&ro->lock);
+  ro->pending = ro->threads;
+  ro->generation++;
+  pthread_cond_broadcast(&ro->start);
+  while (ro->finished != ro->generation)
+    pthread_cond_wait(&ro->done, &ro->lock);
+  pthread_mutex_unlock(&ro->lock);
+
+  /* gather outcome from all workers */
+  for (i = 0; i < ro->n; i++) {
+    results[i].placement = ro->candidates[i];
+    results[i].rollouts = rollouts;
+    results[i].game_overs = 0;
+    score = lines = 0;
+    for (j = 0; j < ro->threads; j++) {
+      score += ro->workers[j].arena.score[i];
+      lines += ro->workers[j].arena.lines[i];
+      results[i].game_overs += ro->workers[j].arena.game_overs[i];
+    }
+    results[i].score = score / rollouts;
+    results[i].lines = lines / rollouts;
+  }
+
+  return ro->n;
+}
+
+void etris_rollout_set_table(ETRIS_ROLLOUT ro, ETRIS_TT tt)
+{
+  int i;
+
+  ro->tt = tt;
+  for (i = 0; i < ro->threads; i++)
+    ro->workers[i].arena.probes = ro->workers[i].arena.hits = 0;
+}
+
+void etris_rollout_table_stats(ETRIS_ROLLOUT ro, unsigned long *probes, 
+			       unsigned long *hits)
+{
+  unsigned long p = 0, h = 0;
+  int i;
+
+  for (i = 0; i < ro->threads; i++) {
+    p += ro->workers[i].arena.probes;
+    h += ro->workers[i].arena.hits;
+  }
+  if (probes)
+    *probes = p;
+  if (hits)
+    *hits = h;
+}
+
+void etris_rollout_destroy(ETRIS_ROLLOUT ro)
+{
+  int i;
+
+  if (ro == NULL)
+    return;
+
+  pthread_mutex_lock(&ro->lock);
+  ro->quit = 1;
+  pthread_cond_broadcast(&ro->start);
+  pthread_mutex_unlock(&ro->lock);
+
+  for (i = 0; i < ro->threads; i++) {
+    pthread_join(ro->workers[i].thread, NULL);
+    free(ro->workers[i].arena.memory);
+  }
+
+  pthread_cond_destroy(&ro->done);
+  pthread_cond_destroy(&ro->start);
+  pthread_mutex_destroy(&ro->lock);
+  free(ro->workers);
+  free(ro->state);
+  free(ro);
+}
+
+ETRIS_ROLLOUT etris_rollout_create(int threads)
+{
+  ETRIS_ROLLOUT ro;
+  int i;
+
+  if (threads < 1 || (ro = calloc(sizeof(struct e_rollout), 1)) == NULL)
+    return NULL;
+
+  if ((ro->workers = calloc(sizeof(struct e_worker), threads)) == NULL) {
+    free(ro);
+    return NULL;
+  }
+
+  pthread_mutex_init(&ro->lock, NULL);
+  pthread_cond_init(&ro->start, NULL);
+  pthread_cond_init(&ro->done, NULL);
+
+  for (i = 0; i < threads; i++) {
+    ro->workers[i].ro = ro;
+    if (pthread_create(&ro->workers[i].thread, NULL, e_worker_main, &ro->workers[i]) != 0) {
+      ro->threads = i;
+      etris_rollout_destroy(ro);
+      return NULL;
+    }
+    ro->threads = i + 1;
+  }
+
+  return ro;
+}
@@ -0,0 +1,124 @@
+/* etris-rollout.h -- Monte Carlo rollouts of etris games on a thread pool.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ETRIS_ROLLOUT_H
+#define __ETRIS_ROLLOUT_H
+
+#include "etris.h"
+#include "etris-tt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* handle to a rollout engine */
+typedef struct e_rollout * ETRIS_ROLLOUT;
+
+/* outcome of rollouts from one placement of the figure currently played */
+struct etris_rollout_result {
+  struct etris_placement placement;
+  int rollouts;
+  int game_overs;
+  double score;
+  double lines;
+};
+
+/** 
+ * Create new rollout engine with `threads' worker threads, each with its 
+ * own scratch memory, sized on first use. Rollouts run headless and do not
+ * allocate memory or share state while playing.
+ *
+ * @param threads Number of worker threads
+ * @return Newly created rollout engine or NULL on error
+ */
+ETRIS_ROLLOUT etris_rollout_create(int threads);
+
+/** 
+ * Stop worker threads and destroy rollout engine.
+ *
+ * @param ro The rollout engine
+ */
+void etris_rollout_destroy(ETRIS_ROLLOUT ro);
+
+/** 
+ * Cache the placement rollouts choose as etris_best_move() would, keyed on
+ * etris_hash() of the position. Rollouts from one start reach the same 
+ * positions over and over, each hit saves evaluating all placements. The
+ * table may be shared with other engines and threads as long as they play
+ * fields of equal dimensions, results are the same with or without it.
+ *
+ * @param ro The rollout engine
+ * @param tt The table to use, or NULL to evaluate every position
+ */
+void etris_rollout_set_table(ETRIS_ROLLOUT ro, ETRIS_TT tt);
+
+/** 
+ * Get number of table probes and hits of rollouts run since the table was
+ * set. Each worker counts its own, so that probing stays free of writes to
+ * shared memory. Not safe while etris_rollout_run() is running.
+ *
+ * @param ro The rollout engine
+ * @param probes Where to store number of probes, or NULL
+ * @param hits Where to store number of probes that found their key, or NULL
+ */
+void etris_rollout_table_stats(ETRIS_ROLLOUT ro, unsigned long *probes, 
+			       unsigned long *hits);
+
+/** 
+ * Play randomized continuations of game `e' for every placement of its 
+ * current figure, see etris_placements(). From each placement `rollouts' 
+ * games are played `depth' more figures ahead, mostly placing figures as
+ * etris_best_move() would and sometimes at random. Unless `e' plays the
+ * fixed ETRIS_SEQUENCE_CYCLE, figures beyond those previewed are redrawn
+ * for each rollout, see etris_seed(). Games with a custom generator of 
+ * figures are refused, rollouts could not follow it without playing it 
+ * ahead. Returns when all rollouts are done, `e' itself is not changed 
+ * and no hooks are called. Results only depend on `seed', not on the 
+ * number of threads.
+ *
+ * @param ro The rollout engine
+ * @param e The etris instance to start from
+ * @param rollouts Number of rollouts per placement
+ * @param depth Number of figures to play in each rollout
+ * @param seed Seed of random choices
+ * @param results Where to store expected score and lines per placement
+ * @param max Size of results, ETRIS_MAX_PLACEMENTS is always enough
+ * @return Number of results, ETRIS_ERR if no figure is being played or 
+ *         `e' has a custom generator, ETRIS_ERR_NOMEM if scratch memory 
+ *         could not be allocated
+ */
+int etris_rollout_run(ETRIS_ROLLOUT ro, ETRIS e, int rollouts, int depth, 
+		      unsigned int seed, struct etris_rollout_result *results, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETRIS_ROLLOUT_H */
@@ -29,6 +29,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <string.h>
+#include <time.h>
+
 #include "etris.h"
 
 #include "SDL.h"
@@ -45,10 +48,41 @@
 #define FIELD_BORDER 1
 #define BLOCK_SIZE 17
 
+#define TICK_MS 10
+
+/* shortest time between two presents, about one display frame */
+#define FRAME_MS 16
+
+/* input to present latency is kept per ms up to this, the last bucket 
+ * holding the rest */
+#define LATENCY_MS 100
+
+/* rectangles to present before falling back to updating the whole screen */
+#define MAX_DIRTY 128
+
+/* digits kept per score line, enough for any int */
+#define MAX_DIGITS 11
+
 SDL_Surface *screen = NULL;
-SDL_Surface *text_surface = NULL;
 TTF_Font *font = NULL;
 
+/* rectangles drawn to since last present, MAX_DIRTY + 1 if they overflowed */
+static SDL_Rect dirty[MAX_DIRTY];
+static int n_dirty;
+
+/* glyphs "0" to "9" side by side in display format, one cell each */
+static SDL_Surface *digits = NULL;
+static int digit_w, digit_h, line_h, number_x;
+
+/* digits shown on each score line */
+static char shown[3][MAX_DIGITS + 1];
+
+/* measurements reported on exit */
+static unsigned long latency[LATENCY_MS + 1];
+static unsigned long wakeups, presents;
+static Uint32 start;
+static clock_t cpu;
+
 static int color[] = {
   0xff444444,
   0xffaaaaaa,
@@ -62,18 +96,46 @@ static int color[] = {
   0xff7f7f7f
 };
 
-void filled_rectangle(SDL_Surface *screen, int x, int y, int w, int h, int color)
+/* Note rectangle as drawn to, joining it with the previous one if it
+ * continues that on the same row, as blocks of a redrawn row do. */
+static void touch(int x, int y, int w, int h)
 {
-  SDL_Rect rect = {x, y, w, h};
+  SDL_Rect *r;
 
-  if (SDL_MUSTLOCK(screen))
-    if (SDL_LockSurface(screen) < 0)
+  if (n_dirty > 0 && n_dirty <= MAX_DIRTY) {
+    r = &dirty[n_dirty - 1];
+    if (r->y == y && r->h == h && r->x + r->w == x) {
+      r->w += w;
       return;
+    }
+  }
+  if (n_dirty >= MAX_DIRTY) {
+    n_dirty = MAX_DIRTY + 1;
+    return;
+  }
+  r = &dirty[n_dirty++];
+  r->x = x;
+  r->y = y;
+  r->w = w;
+  r->h = h;
+}
 
-  SDL_FillRect(screen, &rect, color);
+/* Show what was drawn since last time, only the touched rectangles. */
+static void present(void)
+{
+  if (n_dirty > MAX_DIRTY)
+    SDL_UpdateRect(screen, 0, 0, 0, 0);
+  else if (n_dirty > 0)
+    SDL_UpdateRects(screen, n_dirty, dirty);
+  n_dirty = 0;
+}
 
-  if (SDL_MUSTLOCK(screen))
-    SDL_UnlockSurface(screen);
+void filled_rectangle(SDL_Surface *screen, int x, int y, int w, int h, int color)
+{
+  SDL_Rect rect = {x, y, w, h};
+
+  SDL_FillRect(screen, &rect, color);
+  touch(x, y, w, h);
 }
 
 void draw_block(int x, int y, int c)
@@ -82,51 +144,196 @@ void draw_block(int x, int y, int c)
 		   BLOCK_SIZE, BLOCK_SIZE, color[c]);
 }
 
-void update_score(int score, int lines, int figures)
+/* Render the static labels and the digit atlas once, numbers are then
+ * drawn by blitting digits that changed. */
+static int build_score_panel(void)
 {
+  static const char *labels[3] = {"Score:", "Lines:", "Figures:"};
   SDL_Color color = {0xff, 0xff, 0xff};
   SDL_Color bg_color = {0, 0, 0};
+  SDL_Surface *atlas, *glyph;
   SDL_Rect rect;
-  char text[3][32];
+  char text[2] = "0";
   int w, h, i;
 
-  sprintf(text[0], "Score: %d", score);
-  sprintf(text[1], "Lines: %d", lines);
-  sprintf(text[2], "Figures: %d", figures);
+  line_h = TTF_FontHeight(font) * 1.2;
+  rect.x = 5;
+  rect.y = rect.x;
+  number_x = 0;
+  for (i = 0; i < 3; i++) {
+    if ((glyph = TTF_RenderText_Shaded(font, labels[i], color, bg_color)) == NULL)
+      return -1;
+    SDL_BlitSurface(glyph, NULL, screen, &rect);
+    if (glyph->w > number_x)
+      number_x = glyph->w;
+    SDL_FreeSurface(glyph);
+    rect.y += line_h;
+  }
+  TTF_SizeText(font, " ", &w, &h);
+  number_x += rect.x + w;
 
-  TTF_SizeText(font, text[0], &w, &h); 
-  h *= 1.2;
+  /* digits are laid out in cells as wide as the widest one */
+  digit_w = 0;
+  for (i = 0; i < 10; i++) {
+    text[0] = '0' + i;
+    TTF_SizeText(font, text, &w, &h);
+    if (w > digit_w)
+      digit_w = w;
+  }
+  digit_h = TTF_FontHeight(font);
 
-  filled_rectangle(screen, 0, 0, X_OFFSET, h * 3, 0);
+  atlas = SDL_CreateRGBSurface(SDL_SWSURFACE, digit_w * 10, digit_h, DEPTH, 
+			       0xff0000, 0xff00, 0xff, 0);
+  if (atlas == NULL)
+    return -1;
+  SDL_FillRect(atlas, NULL, 0);
+  for (i = 0; i < 10; i++) {
+    text[0] = '0' + i;
+    if ((glyph = TTF_RenderText_Shaded(font, text, color, bg_color)) == NULL)
+      return -1;
+    rect.x = i * digit_w + (digit_w - glyph->w) / 2;
+    rect.y = 0;
+    SDL_BlitSurface(glyph, NULL, atlas, &rect);
+    SDL_FreeSurface(glyph);
+  }
+
+  /* same format as the screen, so blits are plain copies */
+  digits = SDL_DisplayFormat(atlas);
+  SDL_FreeSurface(atlas);
+  return digits ? 0 : -1;
+}
+
+static void format_number(unsigned int value, char *text)
+{
+  char reversed[MAX_DIGITS];
+  int n = 0;
+
+  do {
+    reversed[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n > 0)
+    *text++ = reversed[--n];
+}
+
+void update_score(int score, int lines, int figures)
+{
+  unsigned int value[3] = {score, lines, figures};
+  char text[MAX_DIGITS + 1];
+  SDL_Rect src, dst;
+  int i, j;
+
+  src.y = 0;
+  src.w = digit_w;
+  src.h = digit_h;
+  dst.w = digit_w;
+  dst.h = digit_h;
 
-  rect.x = 5;
-  rect.y = rect.x;
-  rect.h = h;
-  rect.w = X_OFFSET - rect.x;
   for (i = 0; i < 3; i++) {
-    if (text_surface)
-      SDL_FreeSurface(text_surface);
+    memset(text, 0, sizeof(text));
+    format_number(value[i], text);
+
+    dst.y = 5 + i * line_h;
+    for (j = 0; j < MAX_DIGITS && (text[j] || shown[i][j]); j++) {
+      if (text[j] == shown[i][j])
+	continue;
+      dst.x = number_x + j * digit_w;
+      if (text[j]) {
+	src.x = (text[j] - '0') * digit_w;
+	SDL_BlitSurface(digits, &src, screen, &dst);
+	touch(dst.x, dst.y, digit_w, digit_h);
+      }
+      else
+	filled_rectangle(screen, dst.x, dst.y, digit_w, digit_h, 0);
+      shown[i][j] = text[j];
+    }
+  }
+}
+
+/* Runs in SDL's timer thread, wakes up the main loop. */
+static Uint32 wake_up(Uint32 interval, void *param)
+{
+  SDL_Event event;
+
+  event.type = SDL_USEREVENT;
+  event.user.code = 0;
+  event.user.data1 = NULL;
+  event.user.data2 = NULL;
+  SDL_PushEvent(&event);
+
+  /* one shot */
+  return 0;
+}
+
+/* Print CPU usage and input to present latency of the session. */
+static void report(void)
+{
+  double wall = (SDL_GetTicks() - start) / 1000.0;
+  double used = (double)(clock() - cpu) / CLOCKS_PER_SEC;
+  unsigned long n = 0, sum = 0;
+  int i, p50 = -1, p99 = -1, max = 0;
 
-    text_surface = TTF_RenderText_Shaded(font, text[i], color, bg_color);
-    SDL_BlitSurface(text_surface, NULL, screen, &rect);
-    rect.y += h;
+  for (i = 0; i <= LATENCY_MS; i++)
+    n += latency[i];
+  for (i = 0; i <= LATENCY_MS; i++) {
+    if (latency[i] == 0)
+      continue;
+    sum += latency[i];
+    if (p50 < 0 && sum * 2 >= n)
+      p50 = i;
+    if (p99 < 0 && sum * 100 >= n * 99)
+      p99 = i;
+    max = i;
   }
+
+  printf("%.1f s, cpu %.1f%%, %lu wakeups, %lu presents\n", 
+	 wall, wall > 0 ? 100 * used / wall : 0.0, wakeups, presents);
+  if (n > 0)
+    printf("input to present latency of %lu inputs: p50 %d ms, p99 %d ms, max %d%s ms\n", 
+	   n, p50, p99, max, max == LATENCY_MS ? "+" : "");
+}
+
+/* Play the ticks due by `now' that were not played yet, counted from the
+ * fixed time base `start'. While paused time passes without ticks. Returns
+ * 1 if the field was redrawn. */
+static int catch_up(ETRIS E, Uint32 now, long *ticks, int pause)
+{
+  long due = (now - start) / TICK_MS;
+  int redraw = 0;
+
+  if (due <= *ticks)
+    return 0;
+  if (!pause && etris_deadline(E) > 0 && etris_advance(E, (int)(due - *ticks)) != ETRIS_OK)
+    redraw = 1;
+  *ticks = due;
+  return redraw;
+}
+
+static void quit(ETRIS E)
+{
+  report();
+  etris_destroy(E);
+  TTF_Quit();
+  SDL_Quit();
+  exit(0);
 }
 
 int main(void)
 {
   SDL_Event event;
+  SDL_TimerID timer = NULL;
+  Uint32 now, next_frame, input_at = 0;
+  long ticks = 0, timeout;
+  int rc, deadline, redraw = 0, pause = 0;
   ETRIS E;
-  int rc, next_tick, pause = 0;
 
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) == -1) {
     printf("SDL_Init: %s\n", SDL_GetError());
     exit(1);
   }
-
   screen = SDL_SetVideoMode(X_OFFSET * 2 + (FIELD_WIDTH + FIELD_BORDER * 2) * BLOCK_SIZE, 
 			    (FIELD_HEIGHT + FIELD_BORDER * 2) * BLOCK_SIZE, 
-			    0, SDL_HWSURFACE | SDL_DOUBLEBUF);
+			    0, SDL_SWSURFACE);
   if (!screen) {
     printf("SDL_SetVideoMode: %s\n", SDL_GetError());
     exit(1);
@@ -143,6 +350,11 @@ int main(void)
     exit(1);
   }
 
+  if (build_score_panel() == -1) {
+    printf("Failed to render score panel: %s\n", TTF_GetError());
+    exit(1);
+  }
+
   E = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, draw_block, update_score);
   if (!E) {
     printf("Failed to create etris instance\n");
@@ -152,15 +364,49 @@ int main(void)
   SDL_WM_SetCaption("etris + SDL = Tetris", 0);
   SDL_Flip(screen);
 
-  next_tick = SDL_GetTicks();
+  cpu = clock();
+  start = next_frame = SDL_GetTicks();
 
   while (1) {
-    if (SDL_GetTicks() > next_tick) {
-      next_tick = SDL_GetTicks() + 10;
-      if (!pause && etris_tick(E) == ETRIS_OK_REDRAW)
-        SDL_Flip(screen);
-    } 
-    else if (SDL_PollEvent(&event)) {
+    now = SDL_GetTicks();
+    if (catch_up(E, now, &ticks, pause))
+      redraw = 1;
+
+    /* one present per frame at most, right away if the last was long ago */
+    if (redraw && (Sint32)(now - next_frame) >= 0) {
+      present();
+      presents++;
+      if (input_at) {
+	now = SDL_GetTicks();
+	latency[now - input_at < LATENCY_MS ? now - input_at : LATENCY_MS]++;
+	input_at = 0;
+      }
+      redraw = 0;
+      next_frame = now + FRAME_MS;
+    }
+
+    /* sleep until the next tick that matters, the next frame if a redraw
+     * is pending, or user input */
+    deadline = etris_deadline(E);
+    timeout = -1;
+    if (!pause && deadline > 0)
+      timeout = (ticks + deadline) * TICK_MS - (long)(now - start);
+    if (redraw && (timeout < 0 || (long)(next_frame - now) < timeout))
+      timeout = next_frame - now;
+
+    if (timer)
+      SDL_RemoveTimer(timer);
+    timer = timeout > 0 ? SDL_AddTimer(timeout, wake_up, NULL) : NULL;
+    if (timeout == 0 || !SDL_WaitEvent(&event))
+      continue;
+    wakeups++;
+
+    /* handle all events that queued up before presenting, each at the 
+     * time it is handled, so ticks missed while sleeping come first */
+    do {
+      if (catch_up(E, SDL_GetTicks(), &ticks, pause))
+	redraw = 1;
+      rc = ETRIS_OK;
       switch (event.type) {
       case SDL_KEYDOWN: 
         switch (event.key.keysym.sym) {
@@ -187,23 +433,22 @@ int main(void)
           rc = ETRIS_OK_REDRAW;
           break;
         case SDLK_ESCAPE:
-          etris_destroy(E);
-	  TTF_Quit();
-          SDL_Quit();
-          exit(0);
+	  quit(E);
           break;
+	default:
+	  break;
         }
-        if (rc == ETRIS_OK_REDRAW)
-          SDL_Flip(screen);
+        if (rc == ETRIS_OK_REDRAW) {
+	  redraw = 1;
+	  if (!input_at)
+	    input_at = SDL_GetTicks();
+	}
         break;
 
       case SDL_QUIT:
-        etris_destroy(E);
-	TTF_Quit();
-        SDL_Quit();
-        exit(0);
+	quit(E);
       }
-    }
+    } while (SDL_PollEvent(&event));
   }
 
   return 0;
@@ -0,0 +1,373 @@
+/* etris-server.c -- drive many etris games on a pool of worker threads.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "etris.h"
+#include "etris-server.h"
+
+/* games per unit of work handed to workers */
+#define E_CHUNK 256
+
+/* pending inputs per game, must be a power of two */
+#define E_QUEUE_SIZE 16
+
+#define E_CACHE_LINE 64
+
+/* Bounded multi-producer single-consumer queue of inputs. Each slot has a 
+ * sequence number telling producers and the consumer whose turn it is, so 
+ * producers only race for `head' and the consumer never locks. */
+struct e_queue {
+  unsigned head;
+  unsigned tail;
+  struct {
+    unsigned seq;
+    int input;
+  } slots[E_QUEUE_SIZE];
+};
+
+struct e_worker {
+  pthread_t thread;
+  ETRIS_SERVER s;
+  int index;
+  unsigned next;
+  unsigned end;
+  unsigned begin;
+  unsigned long steals;
+  char pad[E_CACHE_LINE];
+};
+
+struct e_server {
+  ETRIS_POOL pool;
+  int games;
+  int chunks;
+  int threads;
+  struct e_queue *queues;
+  struct e_worker *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned generation;
+  unsigned finished;
+  int pending;
+  int recycled;
+  int quit;
+  unsigned long steps;
+  int dump_steps;
+  void (*dump)(const struct etris_stats *total, void *context);
+  void *dump_context;
+};
+
+static void e_draw_block(int x, int y, int c)
+{
+}
+
+static void e_update_score(int score, int lines, int figures)
+{
+}
+
+static int e_enqueue(struct e_queue *q, int input)
+{
+  unsigned pos, seq;
+  int diff;
+
+  pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  for (;;) {
+    seq = __atomic_load_n(&q->slots[pos & (E_QUEUE_SIZE - 1)].seq, __ATOMIC_ACQUIRE);
+    diff = (int)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, 
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	break;
+    }
+    else if (diff < 0)
+      return ETRIS_ERR;
+    else
+      pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  }
+
+  q->slots[pos & (E_QUEUE_SIZE - 1)].input = input;
+  __atomic_store_n(&q->slots[pos & (E_QUEUE_SIZE - 1)].seq, pos + 1, __ATOMIC_RELEASE);
+
+  return ETRIS_OK;
+}
+
+/* Returns next input or 0 if queue is empty, only called by the worker 
+ * currently owning the game. */
+static int e_dequeue(struct e_queue *q)
+{
+  unsigned pos = q->tail;
+  int input;
+
+  if (__atomic_load_n(&q->slots[pos & (E_QUEUE_SIZE - 1)].seq, __ATOMIC_ACQUIRE) != pos + 1)
+    return 0;
+
+  input = q->slots[pos & (E_QUEUE_SIZE - 1)].input;
+  __atomic_store_n(&q->slots[pos & (E_QUEUE_SIZE - 1)].seq, pos + E_QUEUE_SIZE, 
+		   __ATOMIC_RELEASE);
+  q->tail = pos + 1;
+
+  return input;
+}
+
+/* Apply queued input to and tick games of chunk `c'. */
+static int e_run_chunk(ETRIS_SERVER s, int c)
+{
+  int i, input, first = c * E_CHUNK;
+  int n = (s->games - first) < E_CHUNK ? (s->games - first) : E_CHUNK;
+  ETRIS e;
+
+  for (i = first; i < first + n; i++) {
+    if ((input = e_dequeue(&s->queues[i])) == 0)
+      continue;
+    e = etris_pool_get(s->pool, i);
+    do {
+      switch (input) {
+      case ETRIS_SERVER_LEFT:
+	etris_left(e);
+	break;
+      case ETRIS_SERVER_RIGHT:
+	etris_right(e);
+	break;
+      case ETRIS_SERVER_ROTATE:
+	etris_rotate(e);
+	break;
+      case ETRIS_SERVER_DROP:
+	etris_drop(e);
+	break;
+      case ETRIS_SERVER_HARD_DROP:
+	etris_hard_drop(e);
+	break;
+      }
+    } while ((input = e_dequeue(&s->queues[i])) != 0);
+  }
+
+  return etris_tick_many(s->pool, first, n);
+}
+
+/* Run own chunks first, then steal from the other workers. */
+static void e_work(ETRIS_SERVER s, struct e_worker *w)
+{
+  struct e_worker *v;
+  unsigned c;
+  int i, recycled = 0;
+
+  for (i = 0; i < s->threads; i++) {
+    v = &s->workers[(w->index + i) % s->threads];
+    while ((c = __atomic_fetch_add(&v->next, 1, __ATOMIC_RELAXED)) < v->end) {
+      recycled += e_run_chunk(s, c);
+      if (v != w)
+	__atomic_store_n(&w->steals, w->steals + 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  if (recycled)
+    __atomic_fetch_add(&s->recycled, recycled, __ATOMIC_RELAXED);
+}
+
+static void *e_worker_main(void *arg)
+{
+  struct e_worker *w = arg;
+  ETRIS_SERVER s = w->s;
+  unsigned seen = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&s->lock);
+    while (s->generation == seen && !s->quit)
+      pthread_cond_wait(&s->start, &s->lock);
+    seen = s->generation;
+    if (s->quit) {
+      pthread_mutex_unlock(&s->lock);
+      break;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    e_work(s, w);
+
+    if (__atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+      pthread_mutex_lock(&s->lock);
+      s->finished = seen;
+      pthread_cond_signal(&s->done);
+      pthread_mutex_unlock(&s->lock);
+    }
+  }
+
+  return NULL;
+}
+
+int etris_server_step(ETRIS_SERVER s)
+{
+  int i;
+
+  pthread_mutex_lock(&s->lock);
+  for (i = 0; i < s->threads; i++)
+    s->workers[i].next = s->workers[i].begin;
+  s->pending = s->threads;
+  s->recycled = 0;
+  s->generation++;
+  pthread_cond_broadcast(&s->start);
+  while (s->finished != s->generation)
+    pthread_cond_wait(&s->done, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+
+  if (s->dump && ++s->steps % s->dump_steps == 0) {
+    struct etris_stats total;
+
+    if (etris_pool_stats(s->pool, &total) == ETRIS_OK)
+      s->dump(&total, s->dump_context);
+  }
+
+  return s->recycled;
+}
+
+int etris_server_stats(ETRIS_SERVER s, struct etris_stats *total)
+{
+  return etris_pool_stats(s->pool, total);
+}
+
+void etris_server_set_stats_dump(ETRIS_SERVER s, 
+				 void (*func_dump)(const struct etris_stats *total, void *context),
+				 void *context, int steps)
+{
+  s->dump = steps > 0 ? func_dump : NULL;
+  s->dump_context = context;
+  s->dump_steps = steps;
+  s->steps = 0;
+}
+
+int etris_server_input(ETRIS_SERVER s, int game, int input)
+{
+  if (game < 0 || game >= s->games || 
+      input < ETRIS_SERVER_LEFT || input > ETRIS_SERVER_HARD_DROP)
+    return ETRIS_ERR;
+
+  return e_enqueue(&s->queues[game], input);
+}
+
+unsigned long etris_server_steals(ETRIS_SERVER s)
+{
+  unsigned long steals = 0;
+  int i;
+
+  /* workers count on while a step runs, each only its own counter */
+  for (i = 0; i < s->threads; i++)
+    steals += __atomic_load_n(&s->workers[i].steals, __ATOMIC_RELAXED);
+
+  return steals;
+}
+
+ETRIS etris_server_game(ETRIS_SERVER s, int game)
+{
+  if (game < 0 || game >= s->games)
+    return NULL;
+
+  return etris_pool_get(s->pool, game);
+}
+
+void etris_server_destroy(ETRIS_SERVER s)
+{
+  int i;
+
+  if (s == NULL)
+    return;
+
+  pthread_mutex_lock(&s->lock);
+  s->quit = 1;
+  pthread_cond_broadcast(&s->start);
+  pthread_mutex_unlock(&s->lock);
+
+  for (i = 0; i < s->threads; i++)
+    pthread_join(s->workers[i].thread, NULL);
+
+  pthread_cond_destroy(&s->done);
+  pthread_cond_destroy(&s->start);
+  pthread_mutex_destroy(&s->lock);
+  etris_pool_destroy(s->pool);
+  free(s->workers);
+  free(s->queues);
+  free(s);
+}
+
+ETRIS_SERVER etris_server_create(int games, int threads, 
+				 int width, int height, int border)
+{
+  ETRIS_SERVER s;
+  int i, j;
+
+  if (games < 1 || threads < 1 || (s = calloc(sizeof(struct e_server), 1)) == NULL)
+    return NULL;
+
+  s->games = games;
+  s->chunks = (games + E_CHUNK - 1) / E_CHUNK;
+  s->threads = threads;
+
+  if ((s->pool = etris_pool_create(games, width, height, border, 
+				   e_draw_block, e_update_score)) == NULL ||
+      (s->queues = malloc(games * sizeof(struct e_queue))) == NULL ||
+      (s->workers = calloc(sizeof(struct e_worker), threads)) == NULL) {
+    etris_pool_destroy(s->pool);
+    free(s->queues);
+    free(s);
+    return NULL;
+  }
+
+  for (i = 0; i < games; i++) {
+    s->queues[i].head = 0;
+    s->queues[i].tail = 0;
+    for (j = 0; j < E_QUEUE_SIZE; j++)
+      s->queues[i].slots[j].seq = j;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->start, NULL);
+  pthread_cond_init(&s->done, NULL);
+
+  /* spread chunks evenly, stealing evens out the rest */
+  for (i = 0; i < threads; i++) {
+    s->workers[i].s = s;
+    s->workers[i].index = i;
+    s->workers[i].begin = (unsigned)((long)s->chunks * i / threads);
+    s->workers[i].end = (unsigned)((long)s->chunks * (i + 1) / threads);
+    s->workers[i].next = s->workers[i].end;
+  }
+
+  for (i = 0; i < threads; i++) {
+    if (pthread_create(&s->workers[i].thread, NULL, e_worker_main, &s->workers[i]) != 0) {
+      s->threads = i;
+      etris_server_destroy(s);
+      return NULL;
+    }
+  }
+
+  return s;
+}
@@ -0,0 +1,144 @@
+/* etris-server.h -- drive many etris games on a pool of worker threads.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ETRIS_SERVER_H
+#define __ETRIS_SERVER_H
+
+#include "etris.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* handle to an etris server */
+typedef struct e_server * ETRIS_SERVER;
+
+#define ETRIS_SERVER_LEFT 1
+#define ETRIS_SERVER_RIGHT 2
+#define ETRIS_SERVER_ROTATE 3
+#define ETRIS_SERVER_DROP 4
+#define ETRIS_SERVER_HARD_DROP 5
+
+/** 
+ * Create new server owning `games' headless etris instances, ticked by
+ * `threads' worker threads. Games are split in chunks, each worker has a 
+ * share of the chunks and steals chunks from other workers when done with
+ * its own. A game is only touched by one worker at a time, so the engine 
+ * itself needs no locking. Games that reach game over are recycled.
+ *
+ * @param games Number of games
+ * @param threads Number of worker threads
+ * @return Newly created server or NULL on error
+ * @see etris_create() for the other parameters
+ */
+ETRIS_SERVER etris_server_create(int games, int threads, 
+				 int width, int height, int border);
+
+/** 
+ * Stop worker threads, destroy server and all its games.
+ *
+ * @param s The server
+ */
+void etris_server_destroy(ETRIS_SERVER s);
+
+/** 
+ * Queue user input for a game, applied before the game's next tick. May be
+ * called from any thread at any time, the queue of each game is lock-free.
+ *
+ * @param s The server
+ * @param game Game index
+ * @param input One of ETRIS_SERVER_LEFT, _RIGHT, _ROTATE, _DROP or 
+ *        _HARD_DROP
+ * @return ETRIS_OK or ETRIS_ERR if the game's queue is full or arguments 
+ *         are out of range
+ */
+int etris_server_input(ETRIS_SERVER s, int game, int input);
+
+/** 
+ * Apply queued input and feed all games with a time tick, returns when all
+ * games have been ticked. Should be called every 10 ms from one thread.
+ *
+ * @param s The server
+ * @return Number of games that were recycled after game over
+ */
+int etris_server_step(ETRIS_SERVER s);
+
+/** 
+ * Get number of chunks of games that workers have stolen from each other
+ * since the server was created. May be called while a step runs, from any
+ * thread.
+ *
+ * @param s The server
+ * @return Number of stolen chunks
+ */
+unsigned long etris_server_steals(ETRIS_SERVER s);
+
+/** 
+ * Get instrumentation of all games added up, see etris_stats(). Workers 
+ * are idle between steps, so call it from the thread calling 
+ * etris_server_step().
+ *
+ * @param s The server
+ * @param total Where to store the sum
+ * @return ETRIS_OK or ETRIS_ERR if the library is built without ETRIS_STATS
+ */
+int etris_server_stats(ETRIS_SERVER s, struct etris_stats *total);
+
+/** 
+ * Have etris_server_step() hand instrumentation of all games added up to
+ * `func_dump' every `steps' steps, for monitoring. Adding up reads the 
+ * instrumentation of every game, so keep dumps a second or more apart on
+ * large servers. Nothing is dumped if the library is built without 
+ * ETRIS_STATS.
+ *
+ * @param s The server
+ * @param func_dump Function to call with the sum and `context', see also
+ *        etris_stats_format()
+ * @param context Passed to func_dump
+ * @param steps Number of steps between dumps, 0 to stop dumping
+ */
+void etris_server_set_stats_dump(ETRIS_SERVER s, 
+				 void (*func_dump)(const struct etris_stats *total, void *context),
+				 void *context, int steps);
+
+/** 
+ * Get game instance, for inspection between calls to etris_server_step().
+ *
+ * @param s The server
+ * @param game Game index
+ * @return The etris instance or NULL if `game' is out of range
+ */
+ETRIS etris_server_game(ETRIS_SERVER s, int game);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETRIS_SERVER_H */
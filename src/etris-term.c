@@ -0,0 +1,210 @@
+/* etris-term.c -- a Tetris clone to demonstrate etris (the embeddable Tetris
+ * gaming engine) in an ANSI terminal, drawing from the engine framebuffer.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "etris.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define STRIDE (FIELD_WIDTH + FIELD_BORDER * 2)
+#define ROWS (FIELD_HEIGHT + FIELD_BORDER)
+
+#define TICK_MS 10
+
+static unsigned char cells[STRIDE * ROWS];
+static unsigned char dirty[(ROWS + 7) / 8];
+
+static struct termios saved;
+
+/* 256 color palette index for each block color */
+static int color[] = {
+  238, 248, 15, 203, 83, 63, 227, 207, 87, 244
+};
+
+static long long now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void restore_terminal(void)
+{
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+  printf("\033[0m\033[?25h\033[%d;1H\n", ROWS + 2);
+}
+
+static void raw_terminal(void)
+{
+  struct termios t;
+
+  tcgetattr(STDIN_FILENO, &saved);
+  t = saved;
+  t.c_lflag &= ~(ICANON | ECHO);
+  t.c_cc[VMIN] = 0;
+  t.c_cc[VTIME] = 0;
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &t);
+  atexit(restore_terminal);
+  printf("\033[2J\033[?25l");
+}
+
+/* Repaint rows marked dirty by the engine, and the score. */
+static void present(ETRIS E)
+{
+  int x, y, c, last, score, lines, figures;
+
+  for (y = 0; y < ROWS; y++) {
+    if (!(dirty[y >> 3] & (1 << (y & 7))))
+      continue;
+    printf("\033[%d;1H", y + 1);
+    for (x = 0, last = -1; x < STRIDE; x++) {
+      if ((c = cells[y * STRIDE + x]) != last)
+	printf("\033[48;5;%dm", color[c]);
+      last = c;
+      fputs("  ", stdout);
+    }
+    fputs("\033[0m", stdout);
+  }
+  memset(dirty, 0, sizeof(dirty));
+
+  etris_score(E, &score, &lines, &figures);
+  printf("\033[2;%dHScore: %d\033[3;%dHLines: %d\033[4;%dHFigures: %d", 
+	 STRIDE * 2 + 3, score, STRIDE * 2 + 3, lines, STRIDE * 2 + 3, figures);
+  printf("\033[6;%dH%s", STRIDE * 2 + 3, 
+	 etris_deadline(E) < 0 ? "Game over, r to restart" : "\033[K");
+  fflush(stdout);
+}
+
+/* Returns key pressed, arrow keys are mapped to `h', `j', `k' and `l'. */
+static int get_key(void)
+{
+  unsigned char buf[3];
+  int n = read(STDIN_FILENO, buf, sizeof(buf));
+
+  if (n <= 0)
+    return 0;
+  if (n == 3 && buf[0] == 033 && buf[1] == '[') {
+    switch (buf[2]) {
+    case 'A': return 'k';
+    case 'B': return 'j';
+    case 'C': return 'l';
+    case 'D': return 'h';
+    }
+    return 0;
+  }
+  return buf[0];
+}
+
+int main(void)
+{
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+  long long start, ticks = 0, due;
+  int deadline, timeout, key, pause = 0;
+  ETRIS E;
+
+  /* no hooks, the engine draws into the framebuffer */
+  E = etris_create(FIELD_WIDTH, FIELD_HEIGHT, FIELD_BORDER, NULL, NULL);
+  if (!E) {
+    printf("Failed to create etris instance\n");
+    exit(1);
+  }
+  etris_set_framebuffer(E, cells, dirty);
+
+  raw_terminal();
+  present(E);
+
+  start = now_ms();
+
+  while (1) {
+    /* sleep until next tick that matters or user input */
+    deadline = etris_deadline(E);
+    timeout = -1;
+    if (!pause && deadline > 0)
+      timeout = (int)((ticks + deadline) * TICK_MS - (now_ms() - start));
+    if (timeout < 0 && !pause && deadline > 0)
+      timeout = 0;
+
+    key = poll(&pfd, 1, timeout) > 0 ? get_key() : 0;
+
+    /* catch up ticks from a fixed time base, before the key that woke us
+     * up is handled */
+    due = (now_ms() - start) / TICK_MS;
+    if (pause)
+      ticks = due;
+    else if (due > ticks) {
+      etris_advance(E, (int)(due - ticks));
+      ticks = due;
+    }
+
+    switch (key) {
+    case 'k':
+      etris_rotate(E);
+      break;
+    case 'j':
+      etris_drop(E);
+      break;
+    case 'l':
+      etris_right(E);
+      break;
+    case 'h':
+      etris_left(E);
+      break;
+    case ' ':
+      etris_tick(E);
+      break;
+    case 'p':
+      pause ^= 1;
+      break;
+    case 'r':
+      etris_reset(E);
+      break;
+    case 'q':
+      etris_destroy(E);
+      exit(0);
+    }
+
+    present(E);
+  }
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+/* etris-tt.c -- lock-free transposition table keyed on etris position hashes.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "etris-tt.h"
+
+/* A slot keeps key xor value next to value. Both words are read and 
+ * written separately without locks, a slot half written by another thread
+ * no longer xors back to the key and is taken for a miss. */
+struct e_slot {
+  uint64_t check;
+  uint64_t value;
+};
+
+struct e_tt {
+  struct e_slot *slots;
+  size_t mask;
+};
+
+ETRIS_TT etris_tt_create(size_t entries)
+{
+  ETRIS_TT tt;
+  size_t n;
+
+  if (entries < 1 || (tt = calloc(sizeof(struct e_tt), 1)) == NULL)
+    return NULL;
+
+  for (n = 1; n <= entries / 2; n *= 2)
+    ;
+  if ((tt->slots = calloc(sizeof(struct e_slot), n)) == NULL) {
+    free(tt);
+    return NULL;
+  }
+  tt->mask = n - 1;
+
+  return tt;
+}
+
+void etris_tt_destroy(ETRIS_TT tt)
+{
+  if (tt == NULL)
+    return;
+  free(tt->slots);
+  free(tt);
+}
+
+void etris_tt_clear(ETRIS_TT tt)
+{
+  memset(tt->slots, 0, (tt->mask + 1) * sizeof(struct e_slot));
+}
+
+int etris_tt_probe(ETRIS_TT tt, uint64_t key, uint64_t *value)
+{
+  struct e_slot *s = &tt->slots[key & tt->mask];
+  uint64_t check = __atomic_load_n(&s->check, __ATOMIC_RELAXED);
+  uint64_t v = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+
+  if ((check ^ v) != key || (check | v) == 0)
+    return 0;
+
+  *value = v;
+  return 1;
+}
+
+void etris_tt_store(ETRIS_TT tt, uint64_t key, uint64_t value)
+{
+  struct e_slot *s = &tt->slots[key & tt->mask];
+
+  __atomic_store_n(&s->check, key ^ value, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->value, value, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,92 @@
+/* etris-tt.h -- lock-free transposition table keyed on etris position hashes.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ETRIS_TT_H
+#define __ETRIS_TT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* handle to a transposition table */
+typedef struct e_tt * ETRIS_TT;
+
+/** 
+ * Create new transposition table of `entries' slots, rounded down to a 
+ * power of two. The table never grows, a store replaces whatever was in
+ * its slot. Any number of threads may probe and store concurrently 
+ * without locks, a slot torn by a concurrent store reads as a miss.
+ *
+ * @param entries Number of slots, at least 1
+ * @return Newly created table or NULL on error
+ */
+ETRIS_TT etris_tt_create(size_t entries);
+
+/** 
+ * Destroy transposition table. No thread may use it any more.
+ *
+ * @param tt The table
+ */
+void etris_tt_destroy(ETRIS_TT tt);
+
+/** 
+ * Empty all slots. Not safe while other threads use the table.
+ *
+ * @param tt The table
+ */
+void etris_tt_clear(ETRIS_TT tt);
+
+/** 
+ * Look up value stored for `key', typically etris_hash() of a position.
+ *
+ * @param tt The table
+ * @param key Key to look up
+ * @param value Where to store the value if found
+ * @return 1 if found, 0 if not
+ */
+int etris_tt_probe(ETRIS_TT tt, uint64_t key, uint64_t *value);
+
+/** 
+ * Store `value' for `key', replacing the slot's previous entry.
+ *
+ * @param tt The table
+ * @param key Key to store value for
+ * @param value Value to store
+ */
+void etris_tt_store(ETRIS_TT tt, uint64_t key, uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETRIS_TT_H */
@@ -0,0 +1,231 @@
+/* etris-watch.c -- watch etris games in an ANSI terminal, for spectators on
+ * slow links: only changed cells are sent, see etris-ansi.h.
+ *
+ * Copyright (c) 2011-2012, Jonas Romfelt <jonas at romfelt dot se>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of etris nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "etris.h"
+#include "etris-ansi.h"
+#include "etris-archive.h"
+
+#define FIELD_WIDTH 10
+#define FIELD_HEIGHT 20
+#define FIELD_BORDER 1
+
+#define TICK_NS 10000000L
+
+/* ticks the bot waits before placing a figure and between inputs */
+#define THINK_TICKS 30
+#define MOVE_TICKS 8
+
+/* ticks a lost game is shown before the bot starts over */
+#define GAME_OVER_TICKS 300
+
+/* 256 color palette index for each block color */
+static int color[] = {
+  238, 248, 15, 203, 83, 63, 227, 207, 87, 244
+};
+
+static ETRIS_ANSI screen;
+static int score_column;
+static volatile sig_atomic_t stop;
+
+struct bot {
+  struct etris_placement p;
+  int figures;
+  int wait;
+  int moves;
+};
+
+static void output(const char *data, size_t n, void *context)
+{
+  ssize_t w;
+
+  while (n > 0 && (w = write(STDOUT_FILENO, data, n)) > 0) {
+    data += w;
+    n -= w;
+  }
+}
+
+static void draw_block(int x, int y, int c)
+{
+  etris_ansi_put(screen, x * 2, y, "  ", color[c]);
+}
+
+static void update_score(int score, int lines, int figures)
+{
+  char text[32];
+
+  sprintf(text, "Score: %-10d", score);
+  etris_ansi_put(screen, score_column, 1, text, ETRIS_ANSI_DEFAULT);
+  sprintf(text, "Lines: %-10d", lines);
+  etris_ansi_put(screen, score_column, 2, text, ETRIS_ANSI_DEFAULT);
+  sprintf(text, "Figures: %-10d", figures);
+  etris_ansi_put(screen, score_column, 3, text, ETRIS_ANSI_DEFAULT);
+}
+
+static void on_signal(int sig)
+{
+  stop = 1;
+}
+
+/* Move the figure one input at a time towards the bot's choice, slow 
+ * enough to follow, then drop it. */
+static void bot_tick(ETRIS e, struct bot *b)
+{
+  int figures, x, r;
+
+  etris_score(e, NULL, NULL, &figures);
+  if (figures != b->figures) {
+    b->figures = figures;
+    b->wait = THINK_TICKS;
+    b->moves = etris_best_move(e, &b->p) == ETRIS_OK ? 0 : -1;
+  }
+  if (b->moves < 0 || --b->wait > 0)
+    return;
+
+  b->wait = MOVE_TICKS;
+  etris_figure(e, NULL, &x, NULL, &r);
+  if (b->moves++ > 4 + FIELD_WIDTH || (r == b->p.r && x == b->p.x)) {
+    etris_drop(e);
+    b->moves = -1;
+  }
+  else if (r != b->p.r)
+    etris_rotate(e);
+  else if (x < b->p.x)
+    etris_right(e);
+  else
+    etris_left(e);
+}
+
+int main(int argc, char **argv)
+{
+  struct etris_archive_game game;
+  struct etris_replay_pos pos;
+  struct bot bot;
+  struct timespec next;
+  const unsigned char *log = NULL;
+  ETRIS_ARCHIVE a = NULL;
+  size_t length = 0;
+  unsigned long t;
+  char text[32];
+  int n, over = 0;
+  ETRIS e;
+
+  if (argc != 1 && argc != 3) {
+    printf("usage: %s [ARCHIVE GAME]\n"
+	   "Without arguments the bot plays, with an archive the game is replayed.\n",
+	   argv[0]);
+    return 1;
+  }
+
+  memset(&game, 0, sizeof(game));
+  game.width = FIELD_WIDTH;
+  game.height = FIELD_HEIGHT;
+  game.border = FIELD_BORDER;
+  game.sequence = ETRIS_SEQUENCE_BAG;
+  game.seed = (unsigned int)time(NULL);
+
+  if (argc == 3 && 
+      ((a = etris_archive_open(argv[1])) == NULL ||
+       etris_archive_game(a, atoi(argv[2]), &game, &log, &length) != ETRIS_OK)) {
+    printf("No game %s in archive %s\n", argv[2], argv[1]);
+    return 1;
+  }
+
+  score_column = (game.width + game.border * 2) * 2 + 2;
+  if ((screen = etris_ansi_create(score_column + 20, game.height + game.border, 
+				  output, NULL)) == NULL) {
+    printf("Failed to create screen\n");
+    return 1;
+  }
+  etris_ansi_invalidate(screen);
+
+  e = etris_create(game.width, game.height, game.border, draw_block, update_score);
+  if (!e) {
+    printf("Failed to create etris instance\n");
+    return 1;
+  }
+  etris_set_sequence(e, game.sequence, game.seed);
+  etris_reset(e);
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  output("\033[?25l", 6, NULL);
+
+  memset(&pos, 0, sizeof(pos));
+  memset(&bot, 0, sizeof(bot));
+  bot.figures = -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (t = 0; !stop; t++) {
+    if (a) {
+      if (t > game.ticks)
+	break;
+      etris_replay_to(e, log, length, &pos, t);
+    }
+    else if (etris_deadline(e) < 0) {
+      if (++over >= GAME_OVER_TICKS) {
+	etris_reset(e);
+	over = 0;
+      }
+    }
+    else {
+      bot_tick(e, &bot);
+      etris_tick(e);
+    }
+    etris_ansi_flush(screen);
+
+    /* pace at 100 Hz from a fixed time base */
+    next.tv_nsec += TICK_NS;
+    if (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  /* leave the cursor below the screen */
+  n = sprintf(text, "\033[0m\033[?25h\033[%d;1H\n", game.height + game.border + 1);
+  output(text, n, NULL);
+
+  etris_destroy(e);
+  etris_ansi_destroy(screen);
+  if (a)
+    etris_archive_close(a);
+  return 0;
+}
@@ -34,7 +34,20 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 
+#ifdef ETRIS_STATS
+/* for clock_gettime() */
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#ifdef ETRIS_STATS
+#include <stdio.h>
+#include <time.h>
+#endif
 
 #include "etris.h"
 
@@ -47,6 +60,22 @@
 #define E_ROTATE 3
 #define E_DROP 4
 #define E_TICK 5
+#define E_HARD_DROP 6
+
+/* Input log tokens are varints of (argument << 3 | op), where op is one of
+ * the inputs up to E_TICK, whose argument is a repeat count, or one of 
+ * these. Other inputs are logged once each as the argument of op 0. */
+#define E_LOG_INPUT 0
+#define E_LOG_PLACE 6
+#define E_LOG_RESET 7
+#define E_LOG_OP_BITS 3
+
+/* placements are logged as (x + offset) << 2 | r, x may be negative */
+#define E_LOG_X_OFFSET 4
+
+/* Longest run of one input in a token, longer runs take more tokens. Keeps
+ * the work a few bytes of a log can cause when replayed bounded. */
+#define E_LOG_RUN_MAX 1024
 
 /* TODO be user configurable */
 #define ETRIS_TICKS_NORMAL 50
@@ -60,14 +89,91 @@
 #define ETRIS_SCORE_PER_NEW_FIGURE 5
 #define ETRIS_SCORE_PER_LINE_DROPPED 1
 
+/* One occupancy word per playfield row, bit x is set if column x is taken.
+ * Border columns and the unused high bits are always set, so a full line
+ * compares equal to E_ROW_FULL. */
+#ifdef ETRIS_WIDE_ROWS
+typedef uint64_t e_row;
+#else
+typedef uint32_t e_row;
+#endif
+
+#define E_ROW_BITS ((int)(sizeof(e_row) * 8))
+#define E_ROW_FULL ((e_row)~(e_row)0)
+
+/* keep a few set guard bits to the right of the field, a figure is at 
+ * most 4 blocks wide and may poke out of the field while being checked */
+#define E_ROW_GUARD 4
+
 enum e_state {E_NORMAL, E_DROPPING, E_SHOWING_HIGHLIGHT, E_SHOWING_BLANK, E_REMOVING, E_GAME_OVER};
 
+/* Pool timer of a game that is over. It expires on the next pool tick, 
+ * where etris_tick_many() recycles the game, also when input ended it. */
+#define E_TIMER_OVER 1
+
+/* Number of instances whose timers are counted down in one go before 
+ * looking for expired ones. */
+#define E_TICK_BATCH 64
+
+struct e_pool {
+  int n;
+  size_t size;
+  int *timers;
+  char *instances;
+};
+
+/* Observations of a batch environment are padded to this many bytes. */
+#define E_ENV_ALIGN 16
+
+struct e_env {
+  struct e_pool *pool;
+  int actions;
+  size_t observation_size;
+};
+
+/* Everything from field.lines to the end of the struct is game state, and
+ * so are the rows and colors following the struct in memory. Snapshots 
+ * copy all of it in one go. */
 struct e_etris {
+  struct {
+    void (*draw_block)(int x, int y, int c);
+    void (*update_score)(int score, int lines, int figures);
+    int (*next_figure)(void *context);
+    void *context;
+  } hooks;
+  struct {
+    void (*draw)(const struct etris_block *blocks, int n);
+    unsigned char *screen;
+    unsigned char *shown;
+    struct etris_block *blocks;
+    int n;
+    int force;
+  } batch;
+  struct {
+    unsigned char *cells;
+    unsigned char *dirty;
+  } fb;
+  int *timer;
+  struct {
+    unsigned char *log;
+    size_t size;
+    size_t length;
+    size_t last;
+    uint64_t run;
+    int op;
+    int full;
+  } rec;
+#ifdef ETRIS_STATS
+  struct etris_stats metrics;
+#endif
   struct {
     int width;
     int height;
     int border;
-    char **data;
+    int stride;
+    e_row walls;
+    e_row *rows;
+    char *data;
     int lines[4];
   } field;
   struct {
@@ -82,114 +188,367 @@ struct e_etris {
     unsigned int score;
     unsigned int drops;
   } stats;
-  struct {
-    void (*draw_block)(int x, int y, int c);
-    void (*update_score)(int score, int lines, int figures);
-  } hooks;
   enum e_state state;
   int ticks;
   int speed;
+  struct {
+    int mode;
+    int cycle;
+    uint32_t s[4];
+    unsigned char bag[8];
+    int bag_n;
+    unsigned char queue[ETRIS_PREVIEW_MAX];
+    int head;
+    int n;
+  } next;
+  struct {
+    short top[E_ROW_BITS];
+    short holes[E_ROW_BITS];
+    int top_row;
+    uint64_t hash;
+  } well;
 };
 
+/* Figures are written down as nibble packed blocks 0xXY, where X and Y are
+ * the block offsets within a 4x4 box. The macros below expand them at
+ * compile time into ready-to-use row masks and block offsets, so that no
+ * decoding is done while playing. */
+#define E_BX(b) (((b) >> 4) & 0xf)
+#define E_BY(b) ((b) & 0xf)
+#define E_BIT(b, y) (E_BY(b) == (y) ? 1 << E_BX(b) : 0)
+#define E_MASK(y, b0, b1, b2, b3) \
+  (E_BIT(b0, y) | E_BIT(b1, y) | E_BIT(b2, y) | E_BIT(b3, y))
+#define E_ROTATION(b0, b1, b2, b3) { \
+    {E_MASK(0, b0, b1, b2, b3), E_MASK(1, b0, b1, b2, b3), \
+     E_MASK(2, b0, b1, b2, b3), E_MASK(3, b0, b1, b2, b3)}, \
+    {E_BX(b0), E_BX(b1), E_BX(b2), E_BX(b3)}, \
+    {E_BY(b0), E_BY(b1), E_BY(b2), E_BY(b3)} }
+#define E_FIGURE(offset, color, r0, r1, r2, r3) \
+    E_BX(offset), E_BY(offset), color, \
+    {E_ROTATION r0, E_ROTATION r1, E_ROTATION r2, E_ROTATION r3}
+
+typedef struct _e_rotation {
+  unsigned char rows[4];
+  char x[4];
+  char y[4];
+} e_rotation;
+
 typedef struct _e_figure {
-  char offset;
+  char offset_x;
+  char offset_y;
   char color;
-  char blocks[4][4];
+  e_rotation rotations[4];
 } e_figure;
 
-static e_figure figures[] = {
+static const e_figure figures[] = {
   {
     /* 00#0  0000
      * 00#0  ####
      * 00#0  0000
      * 00#0  0000 */
-    0x00, 3, {{0x20, 0x21, 0x22, 0x23}, {0x01, 0x11, 0x21, 0x31}, {0x20, 0x21, 0x22, 0x23}, {0x01, 0x11, 0x21, 0x31}}
+    E_FIGURE(0x00, 3, (0x20, 0x21, 0x22, 0x23), (0x01, 0x11, 0x21, 0x31),
+	     (0x20, 0x21, 0x22, 0x23), (0x01, 0x11, 0x21, 0x31))
   },
   {
     /* 0000  0000
      * 0#00  0##0
      * 0##0  ##00
      * 00#0  0000 */
-    0x00, 4, {{0x11, 0x12, 0x22, 0x23}, {0x11, 0x21, 0x02, 0x12}, {0x11, 0x12, 0x22, 0x23}, {0x11, 0x21, 0x02, 0x12}}
+    E_FIGURE(0x00, 4, (0x11, 0x12, 0x22, 0x23), (0x11, 0x21, 0x02, 0x12),
+	     (0x11, 0x12, 0x22, 0x23), (0x11, 0x21, 0x02, 0x12))
   },
   {
     /* 0000  0000
      * 00#0  0##0
      * 0##0  00##
      * 0#00  0000 */
-    0x00, 5, {{0x21, 0x12, 0x22, 0x13}, {0x11, 0x21, 0x22, 0x32}, {0x21, 0x12, 0x22, 0x13}, {0x11, 0x21, 0x22, 0x32}}
+    E_FIGURE(0x00, 5, (0x21, 0x12, 0x22, 0x13), (0x11, 0x21, 0x22, 0x32),
+	     (0x21, 0x12, 0x22, 0x13), (0x11, 0x21, 0x22, 0x32))
   },
   {
     /* 0000
      * 0000
      * 0##0
      * 0##0 */
-    0x00, 6, {{0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}, {0x12, 0x22, 0x13, 0x23}}
+    E_FIGURE(0x00, 6, (0x12, 0x22, 0x13, 0x23), (0x12, 0x22, 0x13, 0x23),
+	     (0x12, 0x22, 0x13, 0x23), (0x12, 0x22, 0x13, 0x23))
   },
   {
     /* 0000  0000  0000  0000
      * 00#0  00#0  0000  00#0
      * 0###  00##  0###  0##0
      * 0000  00#0  00#0  00#0 */
-    0x01, 7, {{0x21, 0x12, 0x22, 0x32}, {0x21, 0x22, 0x32, 0x23}, {0x12, 0x22, 0x32, 0x23}, {0x21, 0x12, 0x22, 0x23}}
+    E_FIGURE(0x01, 7, (0x21, 0x12, 0x22, 0x32), (0x21, 0x22, 0x32, 0x23),
+	     (0x12, 0x22, 0x32, 0x23), (0x21, 0x12, 0x22, 0x23))
   },
   {
     /* 0000  0000  0000  0000
      * 00#0  0#00  00##  0000
      * 00#0  0###  00#0  0###
      * 0##0  0000  00#0  000# */
-    0x00, 8, {{0x21, 0x22, 0x23, 0x13}, {0x11, 0x12, 0x22, 0x32}, {0x21, 0x31, 0x22, 0x23}, {0x12, 0x22, 0x32, 0x33}}
+    E_FIGURE(0x00, 8, (0x21, 0x22, 0x23, 0x13), (0x11, 0x12, 0x22, 0x32),
+	     (0x21, 0x31, 0x22, 0x23), (0x12, 0x22, 0x32, 0x33))
   },
   {
     /* 0000  0000  0000  0000 
      * 00#0  0000  0##0  000#
      * 00#0  0###  00#0  0###
      * 00##  0#00  00#0  0000 */
-    0x00, 9, {{0x21, 0x22, 0x23, 0x33}, {0x12, 0x22, 0x32, 0x13}, {0x11, 0x21, 0x22, 0x23}, {0x31, 0x12, 0x22, 0x32}}
+    E_FIGURE(0x00, 9, (0x21, 0x22, 0x23, 0x33), (0x12, 0x22, 0x32, 0x13),
+	     (0x11, 0x21, 0x22, 0x23), (0x31, 0x12, 0x22, 0x32))
   }
 };
 
 #define E_NUMBER_OF_FIGURES (sizeof(figures) / sizeof(e_figure))
 
-/* Draw game field */
-static void e_draw_game_field(ETRIS e)
+/* Append a token to the input log. Runs of the same input grow the last
+ * token in place, a log that is full stays as it was. */
+static void e_record(ETRIS e, int op, uint64_t arg)
+{
+  unsigned char *p;
+  size_t at = e->rec.length;
+  uint64_t v;
+  int n;
+
+  if (e->rec.full)
+    return;
+
+  if (op == e->rec.op && op >= E_LEFT && op <= E_TICK && 
+      (op == E_TICK || e->rec.run + arg <= E_LOG_RUN_MAX)) {
+    arg += e->rec.run;
+    at = e->rec.last;
+  }
+
+  v = arg << E_LOG_OP_BITS | op;
+  for (n = 1; n < 10 && (v >> (7 * n)) != 0; n++)
+    ;
+  if (at + n > e->rec.size) {
+    e->rec.full = 1;
+    return;
+  }
+
+  e->rec.last = at;
+  e->rec.op = op;
+  e->rec.run = arg;
+  for (p = e->rec.log + at; v >= 0x80; v >>= 7)
+    *p++ = (unsigned char)(v | 0x80);
+  *p++ = (unsigned char)v;
+  e->rec.length = p - e->rec.log;
+}
+
+/* Fetch ticks left of a pooled instance from its pool timer. */
+static void e_load_timer(ETRIS e)
+{
+  if (e->timer) {
+    /* ticks counted down by the pool are input too */
+    if (e->rec.log && e->state != E_GAME_OVER && e->ticks > *e->timer)
+      e_record(e, E_TICK, e->ticks - *e->timer);
+    e->ticks = *e->timer;
+  }
+}
+
+/* Publish ticks left of a pooled instance to its pool timer. */
+static void e_store_timer(ETRIS e)
+{
+  if (e->timer)
+    *e->timer = (e->state == E_GAME_OVER) ? E_TIMER_OVER : e->ticks;
+}
+
+/* Instrumentation, compiled out unless ETRIS_STATS is defined. */
+#ifdef ETRIS_STATS
+/* Monotonic clock in nanoseconds. */
+static uint64_t e_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* Count call of entry point `k' started at `start' in its latency bucket. */
+static void e_latency(ETRIS e, int k, uint64_t start)
+{
+  uint64_t ns = e_now() - start;
+  int b;
+
+  for (b = 0; ns > 1 && b < ETRIS_STAT_BUCKETS - 1; b++)
+    ns >>= 1;
+  e->metrics.latency[k][b]++;
+}
+
+#define E_COUNT(e, k, n) ((e)->metrics.calls[k]++, (e)->metrics.cells[k] += (n))
+#define E_NOW() e_now()
+#define E_LATENCY(e, k, t) e_latency(e, k, t)
+#else
+#define E_COUNT(e, k, n) ((void)0)
+#define E_NOW() 0
+#define E_LATENCY(e, k, t) ((void)(t))
+#endif
+
+/* Color of block at (x, y), colors are stored row-major including border. */
+#define E_CELL(e, x, y) ((e)->field.data[(y) * (e)->field.stride + (x)])
+
+/* Occupancy of row `y', rows above the field only have the walls set. */
+#define E_ROW(e, y) ((y) < 0 ? (e)->field.walls : (e)->field.rows[y])
+
+/* Marks a cell of the batch screen as listed in pending blocks. */
+#define E_LISTED 0x80
+
+/* Draw block at (x, y) with "color" `c', either into the framebuffer, right 
+ * away through the draw block hook or by queuing it for the draw batch hook.
+ * A cell is queued only once per batch, whatever number of times it is 
+ * drawn. */
+static void e_draw_block(ETRIS e, int x, int y, int c)
+{
+  int i = y * e->field.stride + x;
+
+  if (e->fb.cells) {
+    e->fb.cells[i] = c;
+    e->fb.dirty[y >> 3] |= 1 << (y & 7);
+    return;
+  }
+
+  if (e->batch.draw == NULL) {
+    if (e->hooks.draw_block) {
+      E_COUNT(e, ETRIS_STAT_DRAW_BLOCK, 1);
+      e->hooks.draw_block(x, y, c);
+    }
+    return;
+  }
+
+  if (!(e->batch.screen[i] & E_LISTED)) {
+    e->batch.blocks[e->batch.n].x = x;
+    e->batch.blocks[e->batch.n].y = y;
+    e->batch.n++;
+  }
+  e->batch.screen[i] = c | E_LISTED;
+}
+
+/* Hand queued blocks to the draw batch hook, leaving out blocks that ended
+ * up with the color they already had, like a figure block erased and drawn
+ * again when moving. */
+static void e_flush_batch(ETRIS e)
+{
+  struct etris_block *b = e->batch.blocks;
+  int i, k, c, n = 0;
+
+  if (e->batch.draw == NULL || e->batch.n == 0)
+    return;
+
+  for (i = 0; i < e->batch.n; i++) {
+    k = b[i].y * e->field.stride + b[i].x;
+    c = e->batch.screen[k] &= ~E_LISTED;
+    if (c != e->batch.shown[k] || e->batch.force) {
+      e->batch.shown[k] = c;
+      b[n].x = b[i].x;
+      b[n].y = b[i].y;
+      b[n].c = c;
+      n++;
+    }
+  }
+
+  e->batch.n = 0;
+  e->batch.force = 0;
+  if (n > 0) {
+    E_COUNT(e, ETRIS_STAT_DRAW_BATCH, n);
+    e->batch.draw(b, n);
+  }
+}
+
+/* Draw rows `first' to `last' of the game field, border included. */
+static void e_draw_rows(ETRIS e, int first, int last)
 {
   int i, j;
 
-  for (i = 0; i < (e->field.width + e->field.border * 2); i++)
-    for (j = 0; j < (e->field.height + e->field.border); j++)
-      e->hooks.draw_block(i, j, e->field.data[i][j]);
+  E_COUNT(e, ETRIS_STAT_DRAW_ROWS, (last - first + 1) * e->field.stride);
+
+  /* framebuffer and colors share layout */
+  if (e->fb.cells) {
+    memcpy(e->fb.cells + first * e->field.stride, &E_CELL(e, 0, first), 
+	   e->field.stride * (last - first + 1));
+    for (j = first; j <= last; j++)
+      e->fb.dirty[j >> 3] |= 1 << (j & 7);
+    return;
+  }
+
+  for (j = first; j <= last; j++)
+    for (i = 0; i < e->field.stride; i++)
+      e_draw_block(e, i, j, E_CELL(e, i, j));
+}
+
+static void e_draw_game_field(ETRIS e)
+{
+  e_draw_rows(e, 0, e->field.height + e->field.border - 1);
 }
 
 /* Draw current figure stored in `e' with "color" `c'. */
 static void e_draw_figure(ETRIS e, char c)
 {
-  int i, bx, by;
-  unsigned short b;
+  const e_rotation *f = &figures[e->figure.n].rotations[e->figure.r];
+  int i, by;
 
   for (i = 0; i < 4; i++) {
-    b = figures[e->figure.n].blocks[e->figure.r][i];
-    bx = e->figure.x + ((b >> 4) & 0xf);
-    by = e->figure.y + (b & 0xf);
+    by = e->figure.y + f->y[i];
     if (by >= 0)
-      e->hooks.draw_block(bx, by, c);
+      e_draw_block(e, e->figure.x + f->x[i], by, c);
   }
 }
 
+/* splitmix64 finalizer, spreads row and figure keys over all 64 bits */
+static uint64_t e_mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* Zobrist key of row `y' holding blocks `r'. Keying whole rows instead of
+ * single blocks keeps a lock at four updates and a line clear at two per
+ * moved row. */
+static uint64_t e_row_key(e_row r, int y)
+{
+  return e_mix((uint64_t)r + 0x9e3779b97f4a7c15ULL * (uint64_t)(y + 1));
+}
+
+/* Hash of rows `first' to `last'. */
+static uint64_t e_hash_rows(ETRIS e, int first, int last)
+{
+  uint64_t h = 0;
+  int y;
+
+  for (y = first; y <= last; y++)
+    h ^= e_row_key(e->field.rows[y], y);
+  return h;
+}
+
 /* Save current figure to game field. 
  * Returns greater than 0 if a block was save on top row or 
  * higher (i.e. game over), else 0 is returned. */
 static int e_save_figure(ETRIS e)
 {
+  const e_rotation *f = &figures[e->figure.n].rotations[e->figure.r];
   int i, bx, by, rc = 0;
-  unsigned short b;
+
+  E_COUNT(e, ETRIS_STAT_SAVE, 4);
 
   for (i = 0; i < 4; i++) {
-    b = figures[e->figure.n].blocks[e->figure.r][i];
-    bx = e->figure.x + ((b >> 4) & 0xf);
-    by = e->figure.y + (b & 0xf);
-    if (by >= 0)
-      e->field.data[bx][by] = figures[e->figure.n].color;
+    bx = e->figure.x + f->x[i];
+    by = e->figure.y + f->y[i];
+    if (by >= 0) {
+      E_CELL(e, bx, by) = figures[e->figure.n].color;
+      e->well.hash ^= e_row_key(e->field.rows[by], by);
+      e->field.rows[by] |= (e_row)1 << bx;
+      e->well.hash ^= e_row_key(e->field.rows[by], by);
+      /* empty blocks skipped over become holes, filling one takes it */
+      if (by < e->well.top[bx]) {
+	e->well.holes[bx] += e->well.top[bx] - by - 1;
+	e->well.top[bx] = by;
+	if (by < e->well.top_row)
+	  e->well.top_row = by;
+      }
+      else
+	e->well.holes[bx]--;
+    }
     if (by <= 0)
       rc++;
   }
@@ -197,39 +556,78 @@ static int e_save_figure(ETRIS e)
   return rc;
 }
 
+/* Shift figure row mask `m' to column `x', which must be within 
+ * -3..E_ROW_BITS-4 and blocks left of column 0 must have been checked for. */
+#define E_SHIFT(m, x) ((x) < 0 ? (e_row)(m) >> -(x) : (e_row)(m) << (x))
+
+/* Check if figure rotation `f' fits at position `x',`y'.
+ * Returns 0 if it does. */
+static int e_check(ETRIS e, const e_rotation *f, int x, int y)
+{
+  int i, by;
+
+  E_COUNT(e, ETRIS_STAT_CHECK, 4);
+
+  /* a box that does not fit in a row is outside the field, whatever its 
+   * blocks are */
+  if (x < -3 || x > E_ROW_BITS - 4)
+    return -1;
+
+  for (i = 0; i < 4; i++) {
+    if (f->rows[i] == 0)
+      continue;
+    by = y + i;
+    if (by > (e->field.height - 1))
+      return -1;
+    /* blocks left of column 0 are outside the field */
+    if (x < 0 && (f->rows[i] & ((1 << -x) - 1)))
+      return -1;
+    if (E_ROW(e, by) & E_SHIFT(f->rows[i], x))
+      return -1;
+  }
+
+  return 0;
+}
+
 /* Check if wanted figure position `x',`y' or rotation `r' is possible.
  * Returns 0 if it is. */
 static int e_check_figure(ETRIS e, int x, int y, int r)
 {
-  int i, bx, by;
-  unsigned short b;
+  return e_check(e, &figures[e->figure.n].rotations[r], x, y);
+}
+
+/* Row that figure `f' at free position (x, y) comes to rest at when 
+ * dropped. Blocks above the top of their column fall freely, so the column
+ * tops give it right away, unless the figure was tucked under an overhang.*/
+static int e_landing(ETRIS e, const e_rotation *f, int x, int y)
+{
+  int i, l, land = INT_MAX;
 
   for (i = 0; i < 4; i++) {
-    b = figures[e->figure.n].blocks[r][i];
-    bx = x + ((b >> 4) & 0xf);
-    by = y + (b & 0xf);
-    if (bx < e->field.border || bx > (e->field.width + e->field.border - 1) ||
-	by > (e->field.height - 1) ||
-	e->field.data[bx][by] != ETRIS_BLOCK_BACKGROUND)
-      return -1;
+    l = e->well.top[x + f->x[i]] - 1 - f->y[i];
+    if (l < land)
+      land = l;
+  }
+  if (land >= y) {
+    E_COUNT(e, ETRIS_STAT_LANDING, 0);
+    return land;
   }
 
-  return 0;
+  for (l = y; e_check(e, f, x, y + 1) == 0; y++)
+    ;
+  E_COUNT(e, ETRIS_STAT_LANDING, y - l);
+  return y;
 }
 
 /* Check if there are complete lines.
  * Returns the number of complete lines. */
 static int e_check_lines(ETRIS e, int start)
 {
-  int x, y, l=0;
+  int y, l=0;
 
-  for (y = start; y < e->field.height && y < (start + 4); y++) {
-    for (x = e->field.border; x < (e->field.width + e->field.border); x++)
-      if (e->field.data[x][y] == ETRIS_BLOCK_BACKGROUND)
-	break;
-    if (x == (e->field.width + e->field.border)) 
+  for (y = start; y < e->field.height && y < (start + 4); y++)
+    if (y >= 0 && e->field.rows[y] == E_ROW_FULL)
       e->field.lines[l++] = y;
-  }
 
   /* clear row indexes for non-complete lines */
   for (y = l; y < 4; y++) 
@@ -247,34 +645,187 @@ static void e_highlight_lines(ETRIS e, char c)
     if ((y = e->field.lines[l]) == 0)
       break;
     for (x = e->field.border; x < (e->field.width + e->field.border); x++) {
-      e->field.data[x][y] = c;
-      e->hooks.draw_block(x, y, c);
+      E_CELL(e, x, y) = c;
+      e_draw_block(e, x, y, c);
     }
   }
 }
 
-/* Remove complete lines. */
-static void e_remove_lines(ETRIS e)
+/* Clear row `y' to background, leaving the border intact. */
+static void e_clear_row(ETRIS e, int y)
 {
-  int l, x, y;
+  char *p = &E_CELL(e, 0, y);
 
-  for (l = 0; l < 4; l++) {
-    for (y = e->field.lines[l]; y > 0; y--)
-      for (x = e->field.border; x < (e->field.width + e->field.border); x++)
-	e->field.data[x][y] = e->field.data[x][y - 1];
+  memset(p, ETRIS_BLOCK_BORDER, e->field.stride);
+  memset(p + e->field.border, ETRIS_BLOCK_BACKGROUND, e->field.width);
+  e->field.rows[y] = e->field.walls;
+}
+
+/* Remove complete lines in one pass. Lines are sorted top to bottom, the 
+ * rows between two lines move down by the number of lines below them, 
+ * rows above the highest block are empty and stay. Returns the first row
+ * that changed, `last' is set to the last one. */
+static int e_remove_lines(ETRIS e, int *last)
+{
+  int l, n, x, y, from, below, first = e->well.top_row;
+
+  for (n = 0; n < 4 && e->field.lines[n] != 0; n++)
+    ;
+  if (n == 0) {
+    E_COUNT(e, ETRIS_STAT_REMOVE_LINES, 0);
+    *last = first - 1;
+    return first;
+  }
+  *last = e->field.lines[n - 1];
+  E_COUNT(e, ETRIS_STAT_REMOVE_LINES, (*last - first + 1) * e->field.stride);
+  e->well.hash ^= e_hash_rows(e, first, *last);
+
+  for (l = n - 1; l >= 0; l--) {
+    from = l > 0 ? e->field.lines[l - 1] + 1 : first;
+    if (from < e->field.lines[l]) {
+      memmove(&e->field.rows[from + n - l], &e->field.rows[from], 
+	      (e->field.lines[l] - from) * sizeof(e_row));
+      memmove(&E_CELL(e, 0, from + n - l), &E_CELL(e, 0, from), 
+	      (e->field.lines[l] - from) * e->field.stride);
+    }
+  }
+  for (y = first; y < first + n; y++)
+    e_clear_row(e, y);
+  e->well.hash ^= e_hash_rows(e, first, *last);
+
+  /* Columns sink by the number of lines. Those topped by the highest line
+   * lose it and the holes below it, down to their next block. */
+  y = e->field.lines[0];
+  for (x = e->field.border; x < e->field.border + e->field.width; x++) {
+    if (e->well.top[x] < y) {
+      e->well.top[x] += n;
+      continue;
+    }
+    for (below = y + n; below < e->field.height && 
+	   (e->field.rows[below] & ((e_row)1 << x)) == 0; below++)
+      ;
+    e->well.holes[x] -= below - y - n;
+    e->well.top[x] = below;
+  }
+
+  e->well.top_row = e->field.height;
+  for (x = e->field.border; x < e->field.border + e->field.width; x++)
+    if (e->well.top[x] < e->well.top_row)
+      e->well.top_row = e->well.top[x];
+
+  for (l = 0; l < n; l++)
     e->field.lines[l] = 0;
+
+  return first;
+}
+
+/* Find column tops, holes and board hash from scratch. */
+static void e_scan_well(ETRIS e)
+{
+  e_row r;
+  int x, y;
+
+  for (x = 0; x < E_ROW_BITS; x++) {
+    e->well.top[x] = e->field.height;
+    e->well.holes[x] = 0;
+  }
+  e->well.top_row = e->field.height;
+
+  for (y = e->field.height - 1; y >= 0; y--) {
+    r = e->field.rows[y] & ~e->field.walls;
+    for (x = e->field.border; x < e->field.border + e->field.width; x++) {
+      if (r & ((e_row)1 << x)) {
+	e->well.holes[x] += e->well.top[x] - y - 1;
+	e->well.top[x] = y;
+      }
+    }
+    if (r)
+      e->well.top_row = y;
+  }
+  e->well.hash = e_hash_rows(e, 0, e->field.height - 1);
+}
+
+/* xorshift128, small and fast enough for the tiniest targets */
+static uint32_t e_random(ETRIS e)
+{
+  uint32_t *s = e->next.s;
+  uint32_t t = s[3], x = s[0];
+
+  s[3] = s[2];
+  s[2] = s[1];
+  s[1] = x;
+  t ^= t << 11;
+  t ^= t >> 8;
+  return s[0] = t ^ x ^ (x >> 19);
+}
+
+/* random number below n, without the bias of a modulo */
+static int e_random_below(ETRIS e, int n)
+{
+  return (int)(((uint64_t)e_random(e) * (uint32_t)n) >> 32);
+}
+
+/* Spread the seed over the whole state, so that seeds differing in one bit
+ * give unrelated sequences. The finalizer is a bijection and the four
+ * inputs differ, so the state is never all zero. */
+static void e_srandom(ETRIS e, unsigned int seed)
+{
+  uint32_t z = seed, x;
+  int j;
+
+  for (j = 0; j < 4; j++) {
+    z += 0x9e3779b9;
+    x = z;
+    x = (x ^ (x >> 16)) * 0x85ebca6b;
+    x = (x ^ (x >> 13)) * 0xc2b2ae35;
+    e->next.s[j] = x ^ (x >> 16);
+  }
+}
+
+/* Draw the next figure number from the sequence. */
+static int e_generate(ETRIS e)
+{
+  int j, n;
+
+  if (e->hooks.next_figure) {
+    n = e->hooks.next_figure(e->hooks.context) % (int)E_NUMBER_OF_FIGURES;
+    return n < 0 ? -n : n;
+  }
+
+  switch (e->next.mode) {
+  case ETRIS_SEQUENCE_UNIFORM:
+    return e_random_below(e, E_NUMBER_OF_FIGURES);
+  case ETRIS_SEQUENCE_BAG:
+    if (e->next.bag_n == 0) {
+      for (j = 0; j < (int)E_NUMBER_OF_FIGURES; j++)
+	e->next.bag[j] = j;
+      e->next.bag_n = E_NUMBER_OF_FIGURES;
+    }
+    j = e_random_below(e, e->next.bag_n);
+    n = e->next.bag[j];
+    e->next.bag[j] = e->next.bag[--e->next.bag_n];
+    return n;
+  default:
+    if (++e->next.cycle >= (int)E_NUMBER_OF_FIGURES)
+      e->next.cycle = 0;
+    return e->next.cycle;
   }
 }
 
 /* Prepare next figure. */
 static void e_next_figure(ETRIS e)
 {
-  /* TODO add random() hook? */
-  if (++e->figure.n >= E_NUMBER_OF_FIGURES)
-    e->figure.n = 0;
+  /* figures already previewed come first */
+  if (e->next.n > 0) {
+    e->figure.n = e->next.queue[e->next.head];
+    e->next.head = (e->next.head + 1) % ETRIS_PREVIEW_MAX;
+    e->next.n--;
+  }
+  else
+    e->figure.n = e_generate(e);
 
-  e->figure.x = e->field.width / 2 + e->field.border - 2 + ((figures[e->figure.n].offset >> 4) & 0xf);
-  e->figure.y = (figures[e->figure.n].offset & 0xf) - 3;
+  e->figure.x = e->field.width / 2 + e->field.border - 2 + figures[e->figure.n].offset_x;
+  e->figure.y = figures[e->figure.n].offset_y - 3;
   e->figure.r = 0;
 
   e->state = E_NORMAL;
@@ -288,7 +839,10 @@ static void e_next_figure(ETRIS e)
 
 void etris_reset(ETRIS e)
 {
-  int i, j;
+  int j;
+
+  if (e->rec.log)
+    e_record(e, E_LOG_RESET, 0);
 
   e->speed = ETRIS_TICKS_NORMAL;
 
@@ -297,63 +851,75 @@ void etris_reset(ETRIS e)
   e->stats.score = 0;
   e->stats.drops = 0;
 
-  for (i = 0; i < (e->field.width + 2 * e->field.border); i++)
-    for (j = 0; j < (e->field.height + e->field.border); j++)
-      e->field.data[i][j] = ETRIS_BLOCK_BORDER;
+  memset(e->field.data, ETRIS_BLOCK_BORDER, 
+	 e->field.stride * (e->field.height + e->field.border));
 
-  for (i = 0; i < e->field.width; i++)
-    for (j = 0; j < e->field.height; j++)
-      e->field.data[e->field.border + i][j] = ETRIS_BLOCK_BACKGROUND;
+  for (j = 0; j < e->field.height; j++)
+    e_clear_row(e, j);
+  e_scan_well(e);
 
   e_next_figure(e);
+  e_store_timer(e);
   etris_redraw(e);
-  e->hooks.update_score(e->stats.score, e->stats.lines, e->stats.figures);
+  if (e->hooks.update_score)
+    e->hooks.update_score(e->stats.score, e->stats.lines, e->stats.figures);
 }
 
 void etris_destroy(ETRIS e) 
 {
-  int i;
+  free(e);
+}
 
-  if (e != NULL) {
-    if (e->field.data != NULL) {
-      for (i = 0; i < (e->field.width + e->field.border * 2); i++) {
-        if(e->field.data[i] == NULL) 
-          break;
-        free(e->field.data[i]);
-      }
-      free(e->field.data);
-    }
-    free(e);
-  }
+/* Round `n' up to a multiple of the alignment needed by an instance, so
+ * that instances can also be packed back to back. */
+union e_align {
+  e_row row;
+  void *p;
+  long l;
+};
+
+#define E_ALIGN(n) (((n) + sizeof(union e_align) - 1) & ~(sizeof(union e_align) - 1))
+
+/* Offsets of row bitboard and block colors in an instance memory block. */
+#define E_ROWS_OFFSET E_ALIGN(sizeof(struct e_etris))
+#define E_DATA_OFFSET(height) (E_ROWS_OFFSET + (height) * sizeof(e_row))
+
+/* Offset of game state in an instance memory block. */
+#define E_STATE_OFFSET offsetof(struct e_etris, field.lines)
+
+/* Size of game state of instance `e'. */
+#define E_STATE_SIZE(e) (E_DATA_OFFSET((e)->field.height) - E_STATE_OFFSET + \
+			 (e)->field.stride * ((e)->field.height + (e)->field.border))
+
+size_t etris_sizeof(int width, int height, int border)
+{
+  int stride = width + border * 2;
+
+  if (width < E_MINIMUM_WIDTH || height < E_MINIMUM_HEIGHT || border < 0 ||
+      stride + E_ROW_GUARD > E_ROW_BITS)
+    return 0;
+
+  return E_ALIGN(E_DATA_OFFSET(height) + stride * (height + border));
 }
 
-ETRIS etris_create(int width, int height, int border, 
-		   void (*func_draw_block)(int x, int y, int c), 
-		   void (*func_update_score)(int score, int lines, int figures))
+ETRIS etris_init_in(void *buffer, int width, int height, int border, 
+		    void (*func_draw_block)(int x, int y, int c), 
+		    void (*func_update_score)(int score, int lines, int figures))
 {
-  ETRIS e;
-  int i;
+  ETRIS e = (ETRIS)buffer;
 
-  if (!func_draw_block || !func_update_score || 
-      width < E_MINIMUM_WIDTH || height < E_MINIMUM_HEIGHT)
+  if (!buffer || etris_sizeof(width, height, border) == 0)
     return NULL;
 
-  if ((e = calloc(sizeof(struct e_etris), 1)) == NULL ||
-      (e->field.data = (char **)malloc((width + border * 2) * sizeof(char *))) == NULL) {
-    etris_destroy(e);
-    return NULL;   
-  }
-
-  for (i = 0; i < (width + border * 2); i++) {
-    if ((e->field.data[i] = (char *)malloc(height + border)) == NULL) {
-      etris_destroy(e);
-      return NULL;   
-    }
-  }
+  memset(e, 0, sizeof(struct e_etris));
 
   e->field.width = width;
   e->field.height = height;
   e->field.border = border;
+  e->field.stride = width + border * 2;
+  e->field.walls = ~((((e_row)1 << width) - 1) << border);
+  e->field.rows = (e_row *)((char *)buffer + E_ROWS_OFFSET);
+  e->field.data = (char *)buffer + E_DATA_OFFSET(height);
 
   e->hooks.draw_block = func_draw_block;
   e->hooks.update_score = func_update_score;
@@ -363,16 +929,116 @@ ETRIS etris_create(int width, int height, int border,
   return e;
 }
 
+ETRIS etris_create(int width, int height, int border, 
+		   void (*func_draw_block)(int x, int y, int c), 
+		   void (*func_update_score)(int score, int lines, int figures))
+{
+  size_t size;
+  void *p;
+  ETRIS e;
+
+  if ((size = etris_sizeof(width, height, border)) == 0 || 
+      (p = malloc(size)) == NULL)
+    return NULL;
+
+  if ((e = etris_init_in(p, width, height, border, 
+			 func_draw_block, func_update_score)) == NULL)
+    free(p);
+
+  return e;
+}
+
 void etris_redraw(ETRIS e)
 {
+  e->batch.force = 1;
   e_draw_game_field(e);
   if (e->state == E_NORMAL || e->state == E_DROPPING) 
     e_draw_figure(e, figures[e->figure.n].color);
+  e_flush_batch(e);
+}
+
+void etris_set_framebuffer(ETRIS e, unsigned char *cells, unsigned char *dirty)
+{
+  e->fb.cells = (cells && dirty) ? cells : NULL;
+  e->fb.dirty = dirty;
+  etris_redraw(e);
+}
+
+void etris_score(ETRIS e, int *score, int *lines, int *figures)
+{
+  if (score)
+    *score = e->stats.score;
+  if (lines)
+    *lines = e->stats.lines;
+  if (figures)
+    *figures = e->stats.figures;
+}
+
+/* Offset of pending blocks in a draw batch buffer. */
+#define E_BATCH_BLOCKS_OFFSET(cells) E_ALIGN(2 * (cells))
+
+size_t etris_batch_sizeof(ETRIS e)
+{
+  size_t cells = e->field.stride * (e->field.height + e->field.border);
+
+  return E_BATCH_BLOCKS_OFFSET(cells) + cells * sizeof(struct etris_block);
+}
+
+void etris_set_draw_batch(ETRIS e, void *buffer, 
+			  void (*func_draw_batch)(const struct etris_block *blocks, int n))
+{
+  size_t cells = e->field.stride * (e->field.height + e->field.border);
+
+  if (buffer == NULL || func_draw_batch == NULL) {
+    e->batch.draw = NULL;
+    etris_redraw(e);
+    return;
+  }
+
+  e->batch.draw = func_draw_batch;
+  e->batch.screen = (unsigned char *)buffer;
+  e->batch.shown = (unsigned char *)buffer + cells;
+  e->batch.blocks = (struct etris_block *)((char *)buffer + E_BATCH_BLOCKS_OFFSET(cells));
+  e->batch.n = 0;
+  memset(e->batch.screen, 0, cells);
+  memset(e->batch.shown, 0, cells);
+
+  etris_redraw(e);
+}
+
+/* Save figure to game field where it stands and score complete lines, 
+ * which are either highlighted before being removed or removed right away.
+ * Returns ETRIS_GAME_OVER if the figure did not fit in the field. */
+static int e_lock_figure(ETRIS e, int animate)
+{
+  int rc, first, last;
+
+  if (e_save_figure(e) > 0) {
+    e->state = E_GAME_OVER;
+    return ETRIS_GAME_OVER;
+  }
+
+  if ((rc = e_check_lines(e, e->figure.y)) > 0) {
+    e->stats.lines += rc;
+    e->stats.score += (ETRIS_SCORE_PER_LINE_MULTIPLIER * (2 << rc));
+
+    if (animate) {
+      e_highlight_lines(e, ETRIS_BLOCK_HIGHLIGHT);
+      e->state = E_SHOWING_HIGHLIGHT;
+      e->ticks = ETRIS_TICKS_SHOWING_HIGHLIGHT;
+      return ETRIS_OK_REDRAW;
+    }
+    first = e_remove_lines(e, &last);
+    e_draw_rows(e, first, last);
+  }
+
+  e_next_figure(e);
+  return ETRIS_OK_REDRAW;
 }
 
 static int e_input(ETRIS e, int input)
 {
-  int x, y, r, l, rc;
+  int x, y, r, first, last;
 
   if (e->state == E_GAME_OVER)
     return ETRIS_GAME_OVER;
@@ -399,6 +1065,18 @@ static int e_input(ETRIS e, int input)
       e->stats.drops++;
     }
     return ETRIS_OK;
+  case E_HARD_DROP:
+    if (e->state != E_NORMAL && e->state != E_DROPPING)
+      return ETRIS_OK;
+    if (e->state == E_NORMAL)
+      e->stats.drops++;
+    /* scored as if dropped tick by tick, down to the tick that locks */
+    y = e_landing(e, &figures[e->figure.n].rotations[r], x, y);
+    e->stats.score += (y - e->figure.y + 1) * ETRIS_SCORE_PER_LINE_DROPPED;
+    e_draw_figure(e, ETRIS_BLOCK_BACKGROUND);
+    e->figure.y = y;
+    e_draw_figure(e, figures[e->figure.n].color);
+    return e_lock_figure(e, 1);
   case E_TICK:
     if (--e->ticks <= 0) {
       switch (e->state) {
@@ -408,8 +1086,8 @@ static int e_input(ETRIS e, int input)
         e_highlight_lines(e, ETRIS_BLOCK_BACKGROUND);
         return ETRIS_OK_REDRAW;
       case E_SHOWING_BLANK :
-        e_remove_lines(e);
-        e_draw_game_field(e);
+        first = e_remove_lines(e, &last);
+        e_draw_rows(e, first, last);
         e->state++;
         e->ticks = ETRIS_TICKS_REMOVING;
         return ETRIS_OK_REDRAW;
@@ -443,41 +1121,73 @@ static int e_input(ETRIS e, int input)
       e_draw_figure(e, figures[e->figure.n].color);
       return ETRIS_OK_REDRAW;
     }
-    else if (input == E_TICK) {
-      if (e_save_figure(e) > 0) {
-        e->state = E_GAME_OVER;
-        return ETRIS_GAME_OVER;
-      }
-      else if ((rc = e_check_lines(e, e->figure.y)) > 0) {
-        e->stats.lines += rc;
-	e->stats.score += (ETRIS_SCORE_PER_LINE_MULTIPLIER * (2 << rc));
-
-        e_highlight_lines(e, ETRIS_BLOCK_HIGHLIGHT);
-        e->state = E_SHOWING_HIGHLIGHT;
-        e->ticks = ETRIS_TICKS_SHOWING_HIGHLIGHT;
-      }
-      else
-        e_next_figure(e);
-      return ETRIS_OK_REDRAW;
-    }
+    else if (input == E_TICK)
+      return e_lock_figure(e, 1);
   }
 
   return ETRIS_OK;
 }
 
-static int e_run(ETRIS e, int input)
+/* Finish handling of an input, `score' is the score before. */
+static void e_done(ETRIS e, unsigned int score)
 {
-  int score = e->stats.score;
-  int rc = e_input(e, input);
-  if (score != e->stats.score)
+  e_store_timer(e);
+  e_flush_batch(e);
+  if (score != e->stats.score && e->hooks.update_score)
     e->hooks.update_score(e->stats.score, e->stats.lines, e->stats.figures);
-
-  return rc;
 }
 
-int etris_left(ETRIS e)
+static int e_run(ETRIS e, int input)
 {
-  return e_run(e, E_LEFT);
+  uint64_t t = E_NOW();
+  unsigned int score = e->stats.score;
+  int rc;
+
+  /* the pool timer is the authority while an instance is pooled */
+  e_load_timer(e);
+  if (e->rec.log)
+    e_record(e, input <= E_TICK ? input : E_LOG_INPUT, input <= E_TICK ? 1 : input);
+
+  rc = e_input(e, input);
+  e_done(e, score);
+  E_LATENCY(e, input - 1, t);
+
+  return rc;
+}
+
+int etris_place(ETRIS e, int x, int r)
+{
+  uint64_t t = E_NOW();
+  unsigned int score = e->stats.score;
+  int y, rc;
+
+  if ((e->state != E_NORMAL && e->state != E_DROPPING) || 
+      r < 0 || r > E_MAXIMUM_ROTATION || 
+      x < -3 || x >= e->field.stride || 
+      e_check_figure(e, x, e->figure.y, r) != 0)
+    return ETRIS_ERR;
+
+  e_load_timer(e);
+  if (e->rec.log)
+    e_record(e, E_LOG_PLACE, (uint64_t)(x + E_LOG_X_OFFSET) << 2 | r);
+
+  y = e_landing(e, &figures[e->figure.n].rotations[r], x, e->figure.y);
+  e_draw_figure(e, ETRIS_BLOCK_BACKGROUND);
+  e->figure.x = x;
+  e->figure.y = y;
+  e->figure.r = r;
+  e_draw_figure(e, figures[e->figure.n].color);
+
+  rc = e_lock_figure(e, 0);
+  e_done(e, score);
+  E_LATENCY(e, ETRIS_STAT_PLACE, t);
+
+  return rc;
+}
+
+int etris_left(ETRIS e)
+{
+  return e_run(e, E_LEFT);
 }
 
 int etris_right(ETRIS e)
@@ -495,7 +1205,863 @@ int etris_drop(ETRIS e)
   return e_run(e, E_DROP);
 }
 
+int etris_hard_drop(ETRIS e)
+{
+  return e_run(e, E_HARD_DROP);
+}
+
+int etris_ghost_position(ETRIS e, int *x, int *y, int *r)
+{
+  if (e->state != E_NORMAL && e->state != E_DROPPING)
+    return ETRIS_ERR;
+
+  if (x)
+    *x = e->figure.x;
+  if (y)
+    *y = e_landing(e, &figures[e->figure.n].rotations[e->figure.r], 
+		   e->figure.x, e->figure.y);
+  if (r)
+    *r = e->figure.r;
+
+  return ETRIS_OK;
+}
+
 int etris_tick(ETRIS e)
 {
   return e_run(e, E_TICK);
 }
+
+int etris_deadline(ETRIS e)
+{
+  if (e->state == E_GAME_OVER)
+    return -1;
+
+  e_load_timer(e);
+  return e->ticks > 0 ? e->ticks : 1;
+}
+
+int etris_advance(ETRIS e, int n)
+{
+  int r, rc = ETRIS_OK;
+
+  if (e->state == E_GAME_OVER)
+    return ETRIS_GAME_OVER;
+
+  e_load_timer(e);
+
+  while (n > 0 && e->state != E_GAME_OVER) {
+    if (n < e->ticks) {
+      if (e->rec.log)
+	e_record(e, E_TICK, n);
+      e->ticks -= n;
+      e_store_timer(e);
+      break;
+    }
+    /* skip straight to the tick that expires the timer */
+    n -= e->ticks > 0 ? e->ticks : 1;
+    if (e->rec.log && e->ticks > 1)
+      e_record(e, E_TICK, e->ticks - 1);
+    e->ticks = 1;
+    e_store_timer(e);
+    if ((r = e_run(e, E_TICK)) != ETRIS_OK)
+      rc = r;
+  }
+
+  return rc;
+}
+
+ETRIS_POOL etris_pool_create(int n, int width, int height, int border, 
+			     void (*func_draw_block)(int x, int y, int c), 
+			     void (*func_update_score)(int score, int lines, int figures))
+{
+  ETRIS_POOL p;
+  ETRIS e;
+  size_t size, timers;
+  int i;
+
+  if (n < 1 || (size = etris_sizeof(width, height, border)) == 0)
+    return NULL;
+
+  timers = E_ALIGN(sizeof(struct e_pool)) + E_ALIGN(n * sizeof(int));
+  if ((p = malloc(timers + n * size)) == NULL)
+    return NULL;
+
+  p->n = n;
+  p->size = size;
+  p->timers = (int *)((char *)p + E_ALIGN(sizeof(struct e_pool)));
+  p->instances = (char *)p + timers;
+
+  for (i = 0; i < n; i++) {
+    if ((e = etris_init_in(p->instances + i * size, width, height, border, 
+			   func_draw_block, func_update_score)) == NULL) {
+      free(p);
+      return NULL;
+    }
+    e->timer = &p->timers[i];
+    e_store_timer(e);
+  }
+
+  return p;
+}
+
+void etris_pool_destroy(ETRIS_POOL p)
+{
+  free(p);
+}
+
+int etris_pool_size(ETRIS_POOL p)
+{
+  return p->n;
+}
+
+ETRIS etris_pool_get(ETRIS_POOL p, int i)
+{
+  if (i < 0 || i >= p->n)
+    return NULL;
+
+  return (ETRIS)(p->instances + i * p->size);
+}
+
+/* Timers are counted down a batch at a time in a loop simple enough for 
+ * the compiler to vectorize. Only instances whose timer expired are run 
+ * through e_input(), which is where state changes happen. */
+int etris_tick_many(ETRIS_POOL p, int first, int n)
+{
+  int i, j, m, expired, over = 0;
+  int *t;
+  ETRIS e;
+
+  if (first < 0 || n < 0 || first + n > p->n)
+    return ETRIS_ERR;
+
+  for (i = first; i < first + n; i += E_TICK_BATCH) {
+    t = &p->timers[i];
+    m = (first + n - i) < E_TICK_BATCH ? (first + n - i) : E_TICK_BATCH;
+
+    expired = 0;
+    for (j = 0; j < m; j++) {
+      t[j]--;
+      expired |= (t[j] <= 0);
+    }
+    if (!expired)
+      continue;
+
+    for (j = 0; j < m; j++) {
+      if (t[j] > 0)
+	continue;
+      /* give back the tick, e_input() counts it down again */
+      t[j]++;
+      e = (ETRIS)(p->instances + (i + j) * p->size);
+      if (e_run(e, E_TICK) == ETRIS_GAME_OVER) {
+	etris_reset(e);
+	over++;
+      }
+    }
+  }
+
+  return over;
+}
+
+int etris_pool_tick(ETRIS_POOL p)
+{
+  return etris_tick_many(p, 0, p->n);
+}
+
+void etris_dimensions(ETRIS e, int *width, int *height, int *border)
+{
+  if (width)
+    *width = e->field.width;
+  if (height)
+    *height = e->field.height;
+  if (border)
+    *border = e->field.border;
+}
+
+void etris_set_sequence(ETRIS e, int mode, unsigned int seed)
+{
+  e->next.mode = mode;
+  e->next.cycle = 0;
+  e->next.bag_n = 0;
+  e->next.head = 0;
+  e->next.n = 0;
+  e_srandom(e, seed);
+}
+
+void etris_seed(ETRIS e, unsigned int seed)
+{
+  e_srandom(e, seed);
+}
+
+void etris_set_generator(ETRIS e, int (*func_next_figure)(void *context), 
+			 void *context)
+{
+  e->hooks.next_figure = func_next_figure;
+  e->hooks.context = context;
+  e->next.head = 0;
+  e->next.n = 0;
+}
+
+int etris_has_generator(ETRIS e)
+{
+  return e->hooks.next_figure != NULL;
+}
+
+int etris_preview(ETRIS e, int *next, int k)
+{
+  int j;
+
+  if (k > ETRIS_PREVIEW_MAX)
+    k = ETRIS_PREVIEW_MAX;
+
+  for (; e->next.n < k; e->next.n++)
+    e->next.queue[(e->next.head + e->next.n) % ETRIS_PREVIEW_MAX] = e_generate(e);
+
+  for (j = 0; j < k; j++)
+    next[j] = e->next.queue[(e->next.head + j) % ETRIS_PREVIEW_MAX];
+
+  return k < 0 ? 0 : k;
+}
+
+void etris_figure(ETRIS e, int *n, int *x, int *y, int *r)
+{
+  if (n)
+    *n = e->figure.n;
+  if (x)
+    *x = e->figure.x;
+  if (y)
+    *y = e->figure.y;
+  if (r)
+    *r = e->figure.r;
+}
+
+uint64_t etris_hash(ETRIS e)
+{
+  if (e->state != E_NORMAL && e->state != E_DROPPING)
+    return e->well.hash;
+  return e->well.hash ^ e_mix(((uint64_t)(e->figure.n * 4 + e->figure.r + 1) << 32) |
+			      (uint32_t)((e->figure.x + 64) << 16 | (e->figure.y + 64)));
+}
+
+int etris_columns(ETRIS e, int *heights, int *holes)
+{
+  int x;
+
+  for (x = 0; x < e->field.width; x++) {
+    if (heights)
+      heights[x] = e->field.height - e->well.top[x + e->field.border];
+    if (holes)
+      holes[x] = e->well.holes[x + e->field.border];
+  }
+
+  return e->well.top_row;
+}
+
+/* Weights of the placement heuristic, scaled by 100. */
+#define E_WEIGHT_HEIGHT -51
+#define E_WEIGHT_LINES 76
+#define E_WEIGHT_HOLES -36
+#define E_WEIGHT_BUMPINESS -18
+
+/* Score of a placement that ends the game. */
+#define E_SCORE_GAME_OVER (INT_MIN / 2)
+
+/* Index of figure x positions in search tables, x is at least -3. */
+#define E_XINDEX(x) ((x) + 4)
+#define E_XPOSITIONS (E_ROW_BITS + 4)
+
+static int e_popcount(e_row m)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll(m);
+#else
+  int n;
+
+  for (n = 0; m; n++)
+    m &= m - 1;
+  return n;
+#endif
+}
+
+/* Evaluate field after saving figure rotation `f' at (x, y), stores number 
+ * of completed lines in `lines'. Works on a copy of the row bitboard, rows
+ * above `top' are known to be empty. */
+static int e_evaluate(ETRIS e, const e_rotation *f, int x, int y, int top, int *lines)
+{
+  int h = e->field.height;
+  e_row rows[h];
+  e_row m, fresh, seen = 0, inner = ~e->field.walls;
+  int heights[E_ROW_BITS];
+  int i, j, k = h, aggregate = 0, holes = 0, bumpiness = 0;
+
+  *lines = 0;
+  for (i = 0; i < 4; i++)
+    if (f->rows[i] && y + i <= 0)
+      return E_SCORE_GAME_OVER;
+
+  /* save figure and drop complete lines, bottom up */
+  for (j = h - 1; j >= 0 && (j >= top || j >= y); j--) {
+    m = e->field.rows[j];
+    if (j >= y && j < y + 4)
+      m |= E_SHIFT(f->rows[j - y], x);
+    if (m == E_ROW_FULL)
+      (*lines)++;
+    else
+      rows[--k] = m;
+  }
+
+  memset(heights, 0, sizeof(heights));
+  for (j = k; j < h; j++) {
+    m = rows[j] & inner;
+    holes += e_popcount(seen & ~m);
+    for (fresh = m & ~seen; fresh; fresh &= fresh - 1) {
+      for (i = 0; !((fresh >> i) & 1); i++)
+	;
+      heights[i] = h - j;
+      aggregate += h - j;
+    }
+    seen |= m;
+  }
+
+  for (i = e->field.border; i < e->field.border + e->field.width - 1; i++)
+    bumpiness += abs(heights[i] - heights[i + 1]);
+
+  return E_WEIGHT_HEIGHT * aggregate + E_WEIGHT_LINES * *lines + 
+    E_WEIGHT_HOLES * holes + E_WEIGHT_BUMPINESS * bumpiness;
+}
+
+/* Rotation `r' of figure `n' has the same blocks as a lower rotation. */
+static int e_same_as_lower(int n, int r, int *lower)
+{
+  for (*lower = 0; *lower < r; (*lower)++)
+    if (memcmp(figures[n].rotations[*lower].rows, figures[n].rotations[r].rows, 4) == 0)
+      return 1;
+  return 0;
+}
+
+int etris_placements(ETRIS e, struct etris_placement *placements, int max)
+{
+  unsigned char reached[4][E_XPOSITIONS];
+  int queue[4 * E_XPOSITIONS];
+  int head = 0, tail = 0, n = 0;
+  int i, x, y, r, nx, nr, lower, top;
+  const e_rotation *f;
+
+  if (e->state != E_NORMAL && e->state != E_DROPPING)
+    return ETRIS_ERR;
+
+  top = e->well.top_row;
+
+  /* find positions reachable by moving and rotating at current height */
+  memset(reached, 0, sizeof(reached));
+  y = e->figure.y;
+  reached[e->figure.r][E_XINDEX(e->figure.x)] = 1;
+  queue[tail++] = e->figure.r * E_XPOSITIONS + E_XINDEX(e->figure.x);
+
+  while (head < tail) {
+    r = queue[head] / E_XPOSITIONS;
+    x = queue[head++] % E_XPOSITIONS - 4;
+    for (i = 0; i < 3; i++) {
+      nx = x + (i == 0 ? -1 : i == 1 ? 1 : 0);
+      nr = i == 2 ? (r + 1) % 4 : r;
+      if (nx < -3 || E_XINDEX(nx) >= E_XPOSITIONS || reached[nr][E_XINDEX(nx)] ||
+	  e_check_figure(e, nx, y, nr) != 0)
+	continue;
+      reached[nr][E_XINDEX(nx)] = 1;
+      queue[tail++] = nr * E_XPOSITIONS + E_XINDEX(nx);
+    }
+  }
+
+  /* drop each reachable position and evaluate the result */
+  for (r = 0; r < 4; r++) {
+    f = &figures[e->figure.n].rotations[r];
+    for (x = -3; E_XINDEX(x) < E_XPOSITIONS && n < max; x++) {
+      if (!reached[r][E_XINDEX(x)] ||
+	  (e_same_as_lower(e->figure.n, r, &lower) && reached[lower][E_XINDEX(x)]))
+	continue;
+      i = e_landing(e, f, x, y);
+      placements[n].x = x;
+      placements[n].y = i;
+      placements[n].r = r;
+      placements[n].score = e_evaluate(e, f, x, i, top, &placements[n].lines);
+      n++;
+    }
+  }
+
+  E_COUNT(e, ETRIS_STAT_PLACEMENTS, n);
+  return n;
+}
+
+int etris_best_move(ETRIS e, struct etris_placement *best)
+{
+  struct etris_placement p[ETRIS_MAX_PLACEMENTS];
+  int i, b = 0, n = etris_placements(e, p, ETRIS_MAX_PLACEMENTS);
+
+  if (n <= 0)
+    return ETRIS_ERR;
+
+  for (i = 1; i < n; i++)
+    if (p[i].score > p[b].score)
+      b = i;
+  *best = p[b];
+
+  return ETRIS_OK;
+}
+
+size_t etris_snapshot_size(ETRIS e)
+{
+  return E_STATE_SIZE(e);
+}
+
+void etris_snapshot(ETRIS e, void *buffer)
+{
+  e_load_timer(e);
+  memcpy(buffer, (char *)e + E_STATE_OFFSET, E_STATE_SIZE(e));
+}
+
+void etris_restore(ETRIS e, const void *buffer)
+{
+  memcpy((char *)e + E_STATE_OFFSET, buffer, E_STATE_SIZE(e));
+  e_store_timer(e);
+}
+
+/* Check that snapshot `s' holds a game instance `e' could be in: figure,
+ * lines, sequence and colors in range, walls in place and the figure 
+ * inside the field. Returns 0 if it does. Column tops, holes and hash are
+ * derived from the rows and rebuilt after restoring. */
+static int e_check_snapshot(ETRIS e, const unsigned char *s)
+{
+  struct e_etris t;
+  const e_rotation *f;
+  const unsigned char *data;
+  e_row rows[4], r;
+  int i, x, y;
+
+  memcpy((char *)&t + E_STATE_OFFSET, s, sizeof(t) - E_STATE_OFFSET);
+  s += E_ROWS_OFFSET - E_STATE_OFFSET;
+  data = s + E_DATA_OFFSET(e->field.height) - E_ROWS_OFFSET;
+
+  if (t.state < E_NORMAL || t.state > E_GAME_OVER ||
+      t.figure.n < 0 || t.figure.n >= (int)E_NUMBER_OF_FIGURES ||
+      t.figure.r < 0 || t.figure.r > E_MAXIMUM_ROTATION ||
+      t.figure.x < -3 || t.figure.x >= e->field.stride ||
+      t.figure.y < -3 || t.figure.y >= e->field.height)
+    return -1;
+
+  if (t.next.mode < ETRIS_SEQUENCE_CYCLE || t.next.mode > ETRIS_SEQUENCE_BAG ||
+      t.next.cycle < 0 || t.next.cycle >= (int)E_NUMBER_OF_FIGURES ||
+      t.next.bag_n < 0 || t.next.bag_n > (int)E_NUMBER_OF_FIGURES ||
+      t.next.head < 0 || t.next.head >= ETRIS_PREVIEW_MAX ||
+      t.next.n < 0 || t.next.n > ETRIS_PREVIEW_MAX)
+    return -1;
+  for (i = 0; i < t.next.bag_n; i++)
+    if (t.next.bag[i] >= E_NUMBER_OF_FIGURES)
+      return -1;
+  for (i = 0; i < t.next.n; i++)
+    if (t.next.queue[(t.next.head + i) % ETRIS_PREVIEW_MAX] >= E_NUMBER_OF_FIGURES)
+      return -1;
+
+  for (y = 0; y < e->field.height; y++) {
+    memcpy(&r, s + y * sizeof(e_row), sizeof(e_row));
+    if ((r & e->field.walls) != e->field.walls)
+      return -1;
+  }
+  for (i = 0; i < e->field.stride * (e->field.height + e->field.border); i++)
+    if (data[i] > E_NUMBER_OF_FIGURES + ETRIS_BLOCK_HIGHLIGHT)
+      return -1;
+
+  /* complete lines waiting for removal are full rows, top to bottom, up
+   * to the first zero */
+  for (i = 0; i < 4 && t.field.lines[i] != 0; i++) {
+    y = t.field.lines[i];
+    if (y < 1 || y >= e->field.height || (i > 0 && y <= t.field.lines[i - 1]))
+      return -1;
+    memcpy(&r, s + y * sizeof(e_row), sizeof(e_row));
+    if (r != E_ROW_FULL)
+      return -1;
+  }
+
+  /* the figure lies within the walls, and is free while it is played */
+  f = &figures[t.figure.n].rotations[t.figure.r];
+  for (i = 0; i < 4; i++) {
+    x = t.figure.x + f->x[i];
+    y = t.figure.y + f->y[i];
+    if (x < e->field.border || x >= e->field.border + e->field.width || 
+	y >= e->field.height)
+      return -1;
+    rows[i] = 0;
+    if (y >= 0)
+      memcpy(&rows[i], s + y * sizeof(e_row), sizeof(e_row));
+    if ((t.state == E_NORMAL || t.state == E_DROPPING) && (rows[i] & ((e_row)1 << x)))
+      return -1;
+  }
+
+  return 0;
+}
+
+int etris_restore_checked(ETRIS e, const void *buffer)
+{
+  if (e_check_snapshot(e, buffer) != 0)
+    return ETRIS_ERR;
+
+  memcpy((char *)e + E_STATE_OFFSET, buffer, E_STATE_SIZE(e));
+  e_scan_well(e);
+  e_store_timer(e);
+  return ETRIS_OK;
+}
+
+ETRIS etris_clone(ETRIS e)
+{
+  size_t size = etris_sizeof(e->field.width, e->field.height, e->field.border);
+  ETRIS c;
+
+  if ((c = malloc(size)) == NULL)
+    return NULL;
+
+  e_load_timer(e);
+  memcpy(c, e, size);
+  c->field.rows = (e_row *)((char *)c + E_ROWS_OFFSET);
+  c->field.data = (char *)c + E_DATA_OFFSET(c->field.height);
+
+  /* output buffers, input log and pool timer belong to the original */
+  c->batch.draw = NULL;
+  c->rec.log = NULL;
+  c->fb.cells = NULL;
+  c->fb.dirty = NULL;
+  c->timer = NULL;
+
+  return c;
+}
+
+void etris_record(ETRIS e, unsigned char *log, size_t size)
+{
+  /* settle ticks the pool counted down, they belong to the previous log */
+  e_load_timer(e);
+
+  e->rec.log = log;
+  e->rec.size = log ? size : 0;
+  e->rec.length = 0;
+  e->rec.last = 0;
+  e->rec.run = 0;
+  e->rec.op = 0;
+  e->rec.full = 0;
+}
+
+int etris_record_length(ETRIS e, size_t *length)
+{
+  e_load_timer(e);
+  *length = e->rec.length;
+  return e->rec.full ? ETRIS_ERR_NOMEM : ETRIS_OK;
+}
+
+int etris_replay_to(ETRIS e, const unsigned char *log, size_t length, 
+		    struct etris_replay_pos *pos, unsigned long ticks)
+{
+  const unsigned char *p, *end = log + length;
+  uint64_t v, arg;
+  unsigned long n;
+  int shift, op;
+
+  while (pos->offset < length) {
+    p = log + pos->offset;
+    for (v = 0, shift = 0; ; shift += 7) {
+      if (p == end || shift > 63)
+	return ETRIS_ERR;
+      v |= (uint64_t)(*p & 0x7f) << shift;
+      if ((*p++ & 0x80) == 0)
+	break;
+    }
+    op = (int)(v & ((1 << E_LOG_OP_BITS) - 1));
+    arg = v >> E_LOG_OP_BITS;
+
+    switch (op) {
+    case E_LOG_INPUT:
+      if (arg != E_HARD_DROP)
+	return ETRIS_ERR;
+      e_run(e, E_HARD_DROP);
+      break;
+    case E_LEFT:
+    case E_RIGHT:
+    case E_ROTATE:
+    case E_DROP:
+      if (arg > E_LOG_RUN_MAX)
+	return ETRIS_ERR;
+      for (; arg > 0; arg--)
+	e_run(e, op);
+      break;
+    case E_TICK:
+      /* input following the last tick wanted is played, the next tick not */
+      if (pos->ticks >= ticks)
+	return e->state == E_GAME_OVER ? ETRIS_GAME_OVER : ETRIS_OK;
+      n = arg - pos->partial < ticks - pos->ticks ? 
+	arg - pos->partial : ticks - pos->ticks;
+      pos->ticks += n;
+      pos->partial += n;
+      /* runs of ticks skip straight to the ticks that do something, and 
+       * a game ends long before INT_MAX ticks pass without input */
+      for (; n > INT_MAX && e->state != E_GAME_OVER; n -= INT_MAX)
+	etris_advance(e, INT_MAX);
+      etris_advance(e, (int)n);
+      if (pos->partial < arg)
+	return e->state == E_GAME_OVER ? ETRIS_GAME_OVER : ETRIS_OK;
+      pos->partial = 0;
+      break;
+    case E_LOG_PLACE:
+      if ((arg >> 2) >= (uint64_t)(e->field.stride + E_LOG_X_OFFSET) ||
+	  etris_place(e, (int)(arg >> 2) - E_LOG_X_OFFSET, (int)(arg & 3)) == ETRIS_ERR)
+	return ETRIS_ERR;
+      break;
+    case E_LOG_RESET:
+      etris_reset(e);
+      break;
+    default:
+      return ETRIS_ERR;
+    }
+    pos->offset = p - log;
+  }
+
+  return e->state == E_GAME_OVER ? ETRIS_GAME_OVER : ETRIS_OK;
+}
+
+int etris_replay(ETRIS e, const unsigned char *log, size_t length)
+{
+  struct etris_replay_pos pos = {0, 0, 0};
+
+  return etris_replay_to(e, log, length, &pos, ULONG_MAX);
+}
+
+ETRIS_ENV etris_env_create(int n, int width, int height, unsigned int seed)
+{
+  ETRIS_ENV env;
+  int i;
+
+  if ((env = malloc(sizeof(struct e_env))) == NULL)
+    return NULL;
+  if ((env->pool = etris_pool_create(n, width, height, 0, NULL, NULL)) == NULL) {
+    free(env);
+    return NULL;
+  }
+  env->actions = 4 * width;
+  env->observation_size = (width * height + 2 * E_NUMBER_OF_FIGURES + 
+			   E_ENV_ALIGN - 1) & ~(size_t)(E_ENV_ALIGN - 1);
+
+  for (i = 0; i < n; i++) {
+    etris_set_sequence(etris_pool_get(env->pool, i), ETRIS_SEQUENCE_BAG, seed + i);
+    etris_reset(etris_pool_get(env->pool, i));
+  }
+
+  return env;
+}
+
+void etris_env_destroy(ETRIS_ENV env)
+{
+  etris_pool_destroy(env->pool);
+  free(env);
+}
+
+int etris_env_actions(ETRIS_ENV env)
+{
+  return env->actions;
+}
+
+size_t etris_env_observation_size(ETRIS_ENV env)
+{
+  return env->observation_size;
+}
+
+/* Box position of figure with its leftmost block in field column `c'. */
+static int e_env_x(ETRIS e, const e_rotation *f, int c)
+{
+  int i, min = 3;
+
+  for (i = 0; i < 4; i++)
+    if (f->x[i] < min)
+      min = f->x[i];
+
+  return c + e->field.border - min;
+}
+
+/* Write observation of game, rows above the highest block are empty. */
+static void e_env_observe(ETRIS e, unsigned char *obs, size_t size)
+{
+  int x, y, next;
+  e_row r;
+
+  memset(obs, 0, e->well.top_row * e->field.width);
+  obs += e->well.top_row * e->field.width;
+  for (y = e->well.top_row; y < e->field.height; y++) {
+    r = e->field.rows[y] >> e->field.border;
+    for (x = 0; x < e->field.width; x++)
+      *obs++ = (unsigned char)((r >> x) & 1);
+  }
+
+  memset(obs, 0, size - e->field.width * e->field.height);
+  etris_preview(e, &next, 1);
+  obs[e->figure.n] = 1;
+  obs[E_NUMBER_OF_FIGURES + next] = 1;
+}
+
+void etris_env_observe(ETRIS_ENV env, unsigned char *observations)
+{
+  int i;
+
+  for (i = 0; i < env->pool->n; i++)
+    e_env_observe(etris_pool_get(env->pool, i), 
+		  observations + i * env->observation_size, env->observation_size);
+}
+
+void etris_env_masks(ETRIS_ENV env, unsigned char *masks)
+{
+  const e_rotation *f;
+  int i, a, width;
+  ETRIS e;
+
+  for (i = 0; i < env->pool->n; i++) {
+    e = etris_pool_get(env->pool, i);
+    width = e->field.width;
+    for (a = 0; a < env->actions; a++) {
+      f = &figures[e->figure.n].rotations[a / width];
+      *masks++ = e_check(e, f, e_env_x(e, f, a % width), e->figure.y) == 0;
+    }
+  }
+}
+
+void etris_env_step(ETRIS_ENV env, const int *actions, unsigned char *observations, 
+		    float *rewards, unsigned char *dones)
+{
+  unsigned int lines;
+  int i, r, done;
+  ETRIS e;
+
+  for (i = 0; i < env->pool->n; i++) {
+    e = etris_pool_get(env->pool, i);
+    lines = e->stats.lines;
+
+    done = 1;
+    if (actions[i] >= 0 && actions[i] < env->actions) {
+      r = actions[i] / e->field.width;
+      done = etris_place(e, e_env_x(e, &figures[e->figure.n].rotations[r], 
+				     actions[i] % e->field.width), r) != ETRIS_OK_REDRAW ||
+	/* the next figure has no room */
+	e_check_figure(e, e->figure.x, e->figure.y, e->figure.r) != 0;
+    }
+
+    rewards[i] = (float)(e->stats.lines - lines);
+    dones[i] = done;
+    if (done)
+      etris_reset(e);
+    e_env_observe(e, observations + i * env->observation_size, env->observation_size);
+  }
+}
+
+
+int etris_stats(ETRIS e, struct etris_stats *stats)
+{
+#ifdef ETRIS_STATS
+  *stats = e->metrics;
+  return ETRIS_OK;
+#else
+  (void)e;
+  memset(stats, 0, sizeof(struct etris_stats));
+  return ETRIS_ERR;
+#endif
+}
+
+void etris_stats_reset(ETRIS e)
+{
+#ifdef ETRIS_STATS
+  memset(&e->metrics, 0, sizeof(struct etris_stats));
+#else
+  (void)e;
+#endif
+}
+
+void etris_stats_add(struct etris_stats *total, const struct etris_stats *stats)
+{
+  int i, j;
+
+  for (i = 0; i < ETRIS_STAT_COUNTERS; i++) {
+    total->calls[i] += stats->calls[i];
+    total->cells[i] += stats->cells[i];
+  }
+  for (i = 0; i < ETRIS_STAT_TIMERS; i++)
+    for (j = 0; j < ETRIS_STAT_BUCKETS; j++)
+      total->latency[i][j] += stats->latency[i][j];
+}
+
+int etris_pool_stats(ETRIS_POOL p, struct etris_stats *total)
+{
+  struct etris_stats s;
+  int i;
+
+  memset(total, 0, sizeof(struct etris_stats));
+  for (i = 0; i < p->n; i++) {
+    if (etris_stats(etris_pool_get(p, i), &s) != ETRIS_OK)
+      return ETRIS_ERR;
+    etris_stats_add(total, &s);
+  }
+
+  return ETRIS_OK;
+}
+
+#ifdef ETRIS_STATS
+/* Upper bound in ns of the bucket holding fraction `q' of `n' calls. */
+static unsigned long long e_percentile(const unsigned long *latency, 
+				       unsigned long n, double q)
+{
+  unsigned long sum = 0;
+  int b;
+
+  for (b = 0; b < ETRIS_STAT_BUCKETS - 1; b++)
+    if ((sum += latency[b]) >= q * n)
+      break;
+  return 1ULL << (b + 1);
+}
+
+int etris_stats_format(const struct etris_stats *stats, char *buf, size_t size)
+{
+  static const char *counters[ETRIS_STAT_COUNTERS] = {
+    "check", "landing", "save", "remove_lines", 
+    "draw_rows", "draw_block", "draw_batch", "placements"
+  };
+  static const char *timers[ETRIS_STAT_TIMERS] = {
+    "left", "right", "rotate", "drop", "tick", "hard_drop", "place"
+  };
+  const unsigned long *l;
+  unsigned long n;
+  size_t len = 0;
+  int i, b;
+
+  /* room left after what was written so far, none once truncated */
+#define E_ROOM (buf && len < size ? buf + len : NULL), (buf && len < size ? size - len : 0)
+
+  for (i = 0; i < ETRIS_STAT_COUNTERS; i++)
+    if (stats->calls[i])
+      len += snprintf(E_ROOM, "%-12s calls %lu cells %lu\n", 
+		      counters[i], stats->calls[i], stats->cells[i]);
+
+  for (i = 0; i < ETRIS_STAT_TIMERS; i++) {
+    l = stats->latency[i];
+    for (b = 0, n = 0; b < ETRIS_STAT_BUCKETS; b++)
+      n += l[b];
+    if (n == 0)
+      continue;
+    for (b = ETRIS_STAT_BUCKETS - 1; l[b] == 0; b--)
+      ;
+    len += snprintf(E_ROOM, "%-12s calls %lu p50 <%lluns p99 <%lluns max <%lluns\n", 
+		    timers[i], n, e_percentile(l, n, 0.5), e_percentile(l, n, 0.99), 
+		    1ULL << (b + 1));
+  }
+
+#undef E_ROOM
+
+  return (int)len;
+}
+#else
+int etris_stats_format(const struct etris_stats *stats, char *buf, size_t size)
+{
+  (void)stats;
+  if (buf && size)
+    buf[0] = '\0';
+  return 0;
+}
+#endif
@@ -31,6 +31,9 @@
 #ifndef __ETRIS_H
 #define __ETRIS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -38,6 +41,19 @@ extern "C" {
 /* handle to an etris instance */
 typedef struct e_etris * ETRIS;
 
+/* handle to a pool of etris instances */
+typedef struct e_pool * ETRIS_POOL;
+
+/* handle to a batch environment, see etris_env_create() */
+typedef struct e_env * ETRIS_ENV;
+
+/* block at (x, y) with color (c), as handed to draw batch hook */
+struct etris_block {
+  short x;
+  short y;
+  short c;
+};
+
 #define ETRIS_OK 0
 #define ETRIS_OK_REDRAW 1
 #define ETRIS_GAME_OVER 2
@@ -48,14 +64,76 @@ typedef struct e_etris * ETRIS;
 #define ETRIS_BLOCK_BORDER 1
 #define ETRIS_BLOCK_HIGHLIGHT 2
 
+/* final position of the figure currently played, see etris_placements() */
+struct etris_placement {
+  int x;
+  int y;
+  int r;
+  int lines;
+  int score;
+};
+
+/* figure sequences, see etris_set_sequence() */
+#define ETRIS_SEQUENCE_CYCLE 0
+#define ETRIS_SEQUENCE_UNIFORM 1
+#define ETRIS_SEQUENCE_BAG 2
+
+/* upper bound of figures to preview */
+#define ETRIS_PREVIEW_MAX 8
+
+/* position in an input log, see etris_replay_to() */
+struct etris_replay_pos {
+  size_t offset;
+  unsigned long ticks;
+  unsigned long partial;
+};
+
+/* internal routines counted by etris_stats(), with what counts as cells */
+#define ETRIS_STAT_CHECK 0        /* collision checks, figure rows tested */
+#define ETRIS_STAT_LANDING 1      /* landing lookups, rows stepped down */
+#define ETRIS_STAT_SAVE 2         /* figures locked, blocks stored */
+#define ETRIS_STAT_REMOVE_LINES 3 /* line clears, blocks moved or cleared */
+#define ETRIS_STAT_DRAW_ROWS 4    /* playfield redraws, blocks drawn */
+#define ETRIS_STAT_DRAW_BLOCK 5   /* draw_block hook calls, blocks */
+#define ETRIS_STAT_DRAW_BATCH 6   /* draw_batch hook calls, blocks */
+#define ETRIS_STAT_PLACEMENTS 7   /* placement searches, placements found */
+#define ETRIS_STAT_COUNTERS 8
+
+/* entry points timed by etris_stats() */
+#define ETRIS_STAT_LEFT 0
+#define ETRIS_STAT_RIGHT 1
+#define ETRIS_STAT_ROTATE 2
+#define ETRIS_STAT_DROP 3
+#define ETRIS_STAT_TICK 4
+#define ETRIS_STAT_HARD_DROP 5
+#define ETRIS_STAT_PLACE 6
+#define ETRIS_STAT_TIMERS 7
+
+/* latency bucket k counts calls taking 2^k to 2^(k+1) - 1 ns */
+#define ETRIS_STAT_BUCKETS 32
+
+/* instrumentation of an instance, see etris_stats() */
+struct etris_stats {
+  unsigned long calls[ETRIS_STAT_COUNTERS];
+  unsigned long cells[ETRIS_STAT_COUNTERS];
+  unsigned long latency[ETRIS_STAT_TIMERS][ETRIS_STAT_BUCKETS];
+};
+
+/* upper bound of placements of one figure */
+#define ETRIS_MAX_PLACEMENTS (4 * 68)
+
 /** 
- * Create new etris instance.
+ * Create new etris instance. The playfield is stored as one machine word per
+ * row, so width + 2 * border must not exceed 28 blocks (60 blocks if the
+ * library is built with ETRIS_WIDE_ROWS defined).
  *
  * @param width The playfield width as number of blocks
  * @param height The playfield height as number of blocks
  * @param border The size of playfield border as number of blocks
- * @param func_draw_block Function call hook for drawing a block at (x, y) with color (c)
- * @param func_update_score Function call hook for refreshing score display
+ * @param func_draw_block Function call hook for drawing a block at (x, y) 
+ *        with color (c), or NULL if not drawing or using a framebuffer
+ * @param func_update_score Function call hook for refreshing score display,
+ *        or NULL if not used
  * @return Newly created etris instance or NULL on error
  */
 ETRIS etris_create(int width, int height, int border, 
@@ -63,12 +141,38 @@ ETRIS etris_create(int width, int height, int border,
 		   void (*func_update_score)(int score, int lines, int figures));
 
 /** 
- * Destroy an etris instance and free allocated memory.
+ * Destroy an etris instance and free allocated memory. Only for instances
+ * returned by etris_create().
  *
  * @param e The etris instance to destroy
  */
 void etris_destroy(ETRIS e);
 
+/** 
+ * Get the number of bytes needed to hold an etris instance, including its
+ * playfield, in one contiguous memory block.
+ *
+ * @param width The playfield width as number of blocks
+ * @param height The playfield height as number of blocks
+ * @param border The size of playfield border as number of blocks
+ * @return Size in bytes or 0 if the dimensions are not supported
+ */
+size_t etris_sizeof(int width, int height, int border);
+
+/** 
+ * Create new etris instance in caller provided memory, no memory is 
+ * allocated. The buffer must be at least etris_sizeof() bytes and aligned
+ * as memory returned by malloc(). The instance lives as long as the buffer
+ * and must not be passed to etris_destroy().
+ *
+ * @param buffer Memory to hold the instance
+ * @return The etris instance (same address as buffer) or NULL on error
+ * @see etris_create() for the other parameters
+ */
+ETRIS etris_init_in(void *buffer, int width, int height, int border, 
+		    void (*func_draw_block)(int x, int y, int c), 
+		    void (*func_update_score)(int score, int lines, int figures));
+
 /** 
  * Feed game engine with a time tick, speed of play has been adjusted to a
  * periodic tick of 10 ms.
@@ -78,6 +182,28 @@ void etris_destroy(ETRIS e);
  */
 int etris_tick(ETRIS e);
 
+/** 
+ * Get the number of ticks until the next tick that changes the game, that
+ * is moves the figure or changes game state. The ticks in between do 
+ * nothing but count down, so hosts may sleep and catch up using 
+ * etris_advance(). User input may change the deadline.
+ *
+ * @param e The etris instance
+ * @return Number of ticks, at least 1, or -1 if game is over
+ */
+int etris_deadline(ETRIS e);
+
+/** 
+ * Feed game engine with `n' time ticks at once, same as calling etris_tick()
+ * `n' times but only the ticks that change the game cost anything.
+ *
+ * @param e The etris instance
+ * @param n Number of ticks
+ * @return ETRIS_GAME_OVER if game is over, ETRIS_OK_REDRAW if there has 
+ *         been re-drawing, ETRIS_OK otherwise
+ */
+int etris_advance(ETRIS e, int n);
+
 /** 
  * User input actions that controls the figure currently played. etris_left()
  * and etris_right() moves the figure one block left and right respectively.
@@ -92,6 +218,46 @@ int etris_right(ETRIS e);
 int etris_rotate(ETRIS e);
 int etris_drop(ETRIS e);
 
+/** 
+ * Drop the figure currently played all the way down and lock it at once,
+ * instead of letting it fall a row per tick as etris_drop() does. It is 
+ * drawn once at the landing row, and scores as if dropped with etris_drop().
+ *
+ * @param e The etris instance
+ * @return ETRIS_OK_REDRAW if the figure was dropped, ETRIS_GAME_OVER if it
+ *         did not fit in the field, ETRIS_OK otherwise
+ */
+int etris_hard_drop(ETRIS e);
+
+/** 
+ * Get the position the figure currently played would land at if dropped,
+ * for drawing a ghost figure. Cheap enough to call after every move.
+ *
+ * @param e The etris instance
+ * @param x Where to store x position, or NULL
+ * @param y Where to store landing row, or NULL
+ * @param r Where to store rotation, or NULL
+ * @return ETRIS_OK or ETRIS_ERR if no figure is being played
+ */
+int etris_ghost_position(ETRIS e, int *x, int *y, int *r);
+
+/** 
+ * Put the figure currently played at position `x' with rotation `r' and let
+ * it fall all the way down and lock at once. Complete lines are removed 
+ * right away, without being highlighted first, and the next figure is 
+ * brought in. The position must be free at the figure's current height, it
+ * is not checked whether it is reachable, see etris_placements(). Meant for
+ * bots and search, where playing through inputs and ticks is too slow.
+ *
+ * @param e The etris instance
+ * @param x Figure x position
+ * @param r Figure rotation, 0 to 3
+ * @return ETRIS_OK_REDRAW, ETRIS_GAME_OVER if the figure did not fit in the
+ *         field or ETRIS_ERR if no figure is being played or the position
+ *         is taken or outside the field
+ */
+int etris_place(ETRIS e, int x, int r);
+
 /** 
  * Redraw all graphics, game field and current figure. Note that this function
  * should be only when it is needed to redraw all graphics. The gaming engine
@@ -101,6 +267,55 @@ int etris_drop(ETRIS e);
  */
 void etris_redraw(ETRIS e);
 
+/** 
+ * Get the number of bytes needed for the buffer passed to 
+ * etris_set_draw_batch().
+ *
+ * @param e The etris instance
+ * @return Size in bytes
+ */
+size_t etris_batch_sizeof(ETRIS e);
+
+/** 
+ * Switch drawing from the draw block hook to a draw batch hook. Instead of 
+ * one call per block, blocks drawn while handling an input, tick or redraw
+ * are collected and handed over in one call. A block drawn several times is 
+ * only handed over once, and not at all if its color did not change. A full
+ * redraw is made right away to sync the host screen.
+ *
+ * @param e The etris instance
+ * @param buffer Memory of at least etris_batch_sizeof() bytes, aligned as
+ *        memory returned by malloc(), must be kept as long as used
+ * @param func_draw_batch Function call hook for drawing `n' blocks, or NULL
+ *        to switch back to the draw block hook
+ */
+void etris_set_draw_batch(ETRIS e, void *buffer, 
+			  void (*func_draw_batch)(const struct etris_block *blocks, int n));
+
+/** 
+ * Let the engine draw directly into a framebuffer instead of calling any
+ * draw hook. The framebuffer has one byte per block, including border and
+ * the figure currently played, row by row, that is (width + 2 * border) *
+ * (height + border) bytes. Drawing to row y sets bit (y & 7) of byte 
+ * (y >> 3) in the dirty row bitmap, the host clears the bits of rows it has
+ * consumed. A full redraw is made right away.
+ *
+ * @param e The etris instance
+ * @param cells Framebuffer, or NULL to go back to the draw hooks
+ * @param dirty Dirty row bitmap of (height + border + 7) / 8 bytes
+ */
+void etris_set_framebuffer(ETRIS e, unsigned char *cells, unsigned char *dirty);
+
+/** 
+ * Get current score, for hosts not using the update score hook.
+ *
+ * @param e The etris instance
+ * @param score Where to store score, or NULL
+ * @param lines Where to store number of removed lines, or NULL
+ * @param figures Where to store number of figures played, or NULL
+ */
+void etris_score(ETRIS e, int *score, int *lines, int *figures);
+
 /** 
  * Reset gaming engine and game field graphics. Typically used when starting
  * a new game session and after game over.
@@ -109,6 +324,435 @@ void etris_redraw(ETRIS e);
  */
 void etris_reset(ETRIS e);
 
+/** 
+ * Create a pool of `n' etris instances of the same dimensions. The instances
+ * and their playfields are packed back to back in one memory block, which 
+ * keeps iterating and ticking many games cache friendly. All instances share
+ * the same hooks.
+ *
+ * @param n Number of instances in pool
+ * @return Newly created pool or NULL on error
+ * @see etris_create() for the other parameters
+ */
+ETRIS_POOL etris_pool_create(int n, int width, int height, int border, 
+			     void (*func_draw_block)(int x, int y, int c), 
+			     void (*func_update_score)(int score, int lines, int figures));
+
+/** 
+ * Destroy a pool and all its instances at once. Pooled instances must not be
+ * passed to etris_destroy().
+ *
+ * @param p The pool to destroy
+ */
+void etris_pool_destroy(ETRIS_POOL p);
+
+/** 
+ * Get number of instances in pool.
+ *
+ * @param p The pool
+ * @return Number of instances
+ */
+int etris_pool_size(ETRIS_POOL p);
+
+/** 
+ * Get instance `i' of pool, to be used with the other etris functions.
+ *
+ * @param p The pool
+ * @param i Instance index, 0 to etris_pool_size() - 1
+ * @return The etris instance or NULL if `i' is out of range
+ */
+ETRIS etris_pool_get(ETRIS_POOL p, int i);
+
+/** 
+ * Feed all instances in pool with a time tick, see etris_tick(). Instances
+ * that reach game over are recycled with etris_reset().
+ *
+ * @param p The pool
+ * @return Number of instances that were recycled
+ */
+int etris_pool_tick(ETRIS_POOL p);
+
+/** 
+ * Feed instances `first' to `first + n - 1' of pool with a time tick, as
+ * etris_pool_tick() does for all instances. The pool keeps the tick timers
+ * of its instances in one array, so instances that are only waiting for 
+ * their timer to expire are ticked in a tight loop without calling into
+ * the game logic.
+ *
+ * @param p The pool
+ * @param first Index of first instance to tick
+ * @param n Number of instances to tick
+ * @return Number of instances that were recycled or ETRIS_ERR if the range
+ *         is out of bounds
+ */
+int etris_tick_many(ETRIS_POOL p, int first, int n);
+
+/** 
+ * Get playfield dimensions.
+ *
+ * @param e The etris instance
+ * @param width Where to store width, or NULL
+ * @param height Where to store height, or NULL
+ * @param border Where to store border, or NULL
+ */
+void etris_dimensions(ETRIS e, int *width, int *height, int *border);
+
+/** 
+ * Select the sequence of figures to play. ETRIS_SEQUENCE_CYCLE plays all
+ * figures in a fixed order and is the default. ETRIS_SEQUENCE_UNIFORM draws
+ * every figure at random, ETRIS_SEQUENCE_BAG deals the seven figures in
+ * random order before dealing them again. Random sequences come from a
+ * generator kept inside the instance, so the same seed and input play the
+ * same game on every platform. Previewed figures are dropped, the figure
+ * currently played is not, call etris_reset() to start with the new
+ * sequence right away.
+ *
+ * @param e The etris instance
+ * @param mode One of ETRIS_SEQUENCE_*
+ * @param seed Seed of the random generator
+ */
+void etris_set_sequence(ETRIS e, int mode, unsigned int seed);
+
+/** 
+ * Reseed the random generator without touching the sequence mode, the 
+ * figures already previewed or the rest of the current bag. Figures drawn
+ * from here on will differ, which is what a look-ahead search wants after
+ * restoring a snapshot.
+ *
+ * @param e The etris instance
+ * @param seed Seed of the random generator
+ */
+void etris_seed(ETRIS e, unsigned int seed);
+
+/** 
+ * Install a custom generator of figures, replacing the built-in sequences.
+ * It may be called ahead of time for etris_preview(). Previewed figures are
+ * dropped.
+ *
+ * @param e The etris instance
+ * @param func_next_figure Returns the next figure number, 0 to 6, or NULL
+ *                         to go back to the built-in sequence
+ * @param context Passed on to func_next_figure
+ */
+void etris_set_generator(ETRIS e, int (*func_next_figure)(void *context), 
+			 void *context);
+
+/** 
+ * Tell whether a custom generator of figures is installed.
+ *
+ * @param e The etris instance
+ * @return 1 if one is, 0 if figures come from the built-in sequences
+ */
+int etris_has_generator(ETRIS e);
+
+/** 
+ * Look at the figures coming after the one currently played. They are 
+ * drawn from the sequence as needed and then kept until played, so 
+ * previewing does not change the game.
+ *
+ * @param e The etris instance
+ * @param next Where to store the figure numbers, next one first
+ * @param k Number of figures wanted, at most ETRIS_PREVIEW_MAX
+ * @return Number of figures stored
+ */
+int etris_preview(ETRIS e, int *next, int k);
+
+/** 
+ * Get figure currently played and its position.
+ *
+ * @param e The etris instance
+ * @param n Where to store figure number, or NULL
+ * @param x Where to store x position, or NULL
+ * @param y Where to store y position, or NULL
+ * @param r Where to store rotation, or NULL
+ */
+void etris_figure(ETRIS e, int *n, int *x, int *y, int *r);
+
+/** 
+ * Get height and holes of each column of the playfield. The engine keeps
+ * them up to date as figures lock and lines are removed, so this is cheap.
+ * The figure currently played is not counted.
+ *
+ * @param e The etris instance
+ * @param heights Where to store `width' column heights, counted in blocks
+ *        from the bottom up to and including the highest block, or NULL
+ * @param holes Where to store `width' counts of empty blocks below the
+ *        highest block of each column, or NULL
+ * @return Row of the highest block, or `height' if the field is empty
+ */
+int etris_columns(ETRIS e, int *heights, int *holes);
+
+/** 
+ * Get 64 bit Zobrist hash of the playfield and the figure currently played,
+ * including its position and rotation. The playfield part is kept up to
+ * date as figures lock and lines are removed, so this is cheap. Equal 
+ * positions, however they were reached, hash equal, which makes it a key 
+ * for caching search results, see etris-tt.h. Score, preview and timers 
+ * are not hashed.
+ *
+ * @param e The etris instance
+ * @return Hash of current position, of the playfield only while no
+ *         figure is played
+ */
+uint64_t etris_hash(ETRIS e);
+
+/** 
+ * Find all final placements of the figure currently played, that is every
+ * position and rotation reachable by moving and rotating the figure at its
+ * current height and then letting it fall. Each placement is scored by a
+ * heuristic weighing aggregate column height, holes, bumpiness and 
+ * completed lines. Rotations with identical blocks are only listed once.
+ *
+ * @param e The etris instance
+ * @param placements Where to store placements
+ * @param max Size of placements, ETRIS_MAX_PLACEMENTS is always enough
+ * @return Number of placements or ETRIS_ERR if no figure is being played
+ */
+int etris_placements(ETRIS e, struct etris_placement *placements, int max);
+
+/** 
+ * Find the placement with the best score, see etris_placements(). A bot 
+ * reaches it by rotating to `r' and moving to `x', then dropping.
+ *
+ * @param e The etris instance
+ * @param best Where to store the best placement
+ * @return ETRIS_OK or ETRIS_ERR if no figure is being played
+ */
+int etris_best_move(ETRIS e, struct etris_placement *best);
+
+/** 
+ * Get the number of bytes needed to hold a snapshot of the game state.
+ *
+ * @param e The etris instance
+ * @return Size in bytes
+ */
+size_t etris_snapshot_size(ETRIS e);
+
+/** 
+ * Save complete game state, that is game field, figure, score and timing,
+ * to a flat buffer with a single copy. No hooks are called.
+ *
+ * @param e The etris instance
+ * @param buffer Memory of at least etris_snapshot_size() bytes
+ */
+void etris_snapshot(ETRIS e, void *buffer);
+
+/** 
+ * Restore game state saved by etris_snapshot() of an instance with the same
+ * dimensions, with a single copy. No hooks are called, call etris_redraw()
+ * if the host screen needs to catch up.
+ *
+ * @param e The etris instance
+ * @param buffer Snapshot
+ */
+void etris_restore(ETRIS e, const void *buffer);
+
+/** 
+ * Restore game state from a snapshot that can not be trusted, such as one
+ * read from a file, as etris_restore() does. The snapshot is checked to 
+ * hold a game the instance could be in before anything is copied, which 
+ * costs a pass over the game field.
+ *
+ * @param e The etris instance
+ * @param buffer Snapshot of etris_snapshot_size() bytes
+ * @return ETRIS_OK or ETRIS_ERR if the snapshot does not check out, `e' 
+ *         is then left as it was
+ */
+int etris_restore_checked(ETRIS e, const void *buffer);
+
+/** 
+ * Create new etris instance as a copy of another, including game state and
+ * hooks but not the draw batch or framebuffer output. No hooks are called.
+ * The copy is not part of any pool and is destroyed with etris_destroy().
+ *
+ * @param e The etris instance to copy
+ * @return Newly created etris instance or NULL on error
+ */
+ETRIS etris_clone(ETRIS e);
+
+/** 
+ * Record all input from now on into `log', including time ticks whether 
+ * fed one by one, through etris_advance() or by a pool, placements and
+ * resets. Repeated input is run-length encoded, a game takes some hundred
+ * bytes. The log starts from the current game, so a replay must begin with
+ * the same dimensions, sequence and seed, see etris_set_sequence(). 
+ * Restoring snapshots while recording makes the log useless.
+ *
+ * @param e The etris instance
+ * @param log Where to store the log, or NULL to stop recording
+ * @param size Size of log in bytes
+ */
+void etris_record(ETRIS e, unsigned char *log, size_t size);
+
+/** 
+ * Get length of input log recorded so far.
+ *
+ * @param e The etris instance
+ * @param length Where to store number of bytes used
+ * @return ETRIS_OK or ETRIS_ERR_NOMEM if the log is full, it then holds
+ *         the input up to where it filled up
+ */
+int etris_record_length(ETRIS e, size_t *length);
+
+/** 
+ * Play input log recorded by etris_record() on `e', as fast as possible. 
+ * Runs of time ticks skip straight to the ticks that change the game, see
+ * etris_advance(). Hooks are called as usual, replay on an instance without
+ * hooks to verify a game, comparing etris_score() with the original.
+ *
+ * @param e The etris instance
+ * @param log Input log
+ * @param length Length of log in bytes
+ * @return ETRIS_OK, ETRIS_GAME_OVER if the game is over when the log ends 
+ *         or ETRIS_ERR if the log is corrupt or does not fit the game
+ */
+int etris_replay(ETRIS e, const unsigned char *log, size_t length);
+
+/** 
+ * Play input log recorded by etris_record() on `e' up to a given time tick,
+ * as etris_replay() does. Replay stops right before the tick after `ticks'
+ * time ticks, so the game ends up as it was at that time, input included.
+ * Position `pos' is advanced and can be kept along with a snapshot to 
+ * continue from there later. Start with all members of `pos' zero.
+ *
+ * @param e The etris instance
+ * @param log Input log
+ * @param length Length of log in bytes
+ * @param pos Position in log to continue from, updated
+ * @param ticks Number of time ticks from start of log to stop at
+ * @return ETRIS_OK, ETRIS_GAME_OVER if the game is over or ETRIS_ERR if 
+ *         the log is corrupt or does not fit the game
+ */
+int etris_replay_to(ETRIS e, const unsigned char *log, size_t length, 
+		    struct etris_replay_pos *pos, unsigned long ticks);
+
+/** 
+ * Create batch environment of `n' headless games for training agents, kept
+ * in one pool. Each step places the figure of every game at once, the 
+ * action of a game being rotation * width + column of the figure's 
+ * leftmost block. Games play 7-bag sequences seeded from `seed'. Steps 
+ * write to caller buffers and allocate nothing.
+ *
+ * @param n Number of games
+ * @param width The playfield width as number of blocks
+ * @param height The playfield height as number of blocks
+ * @param seed Seed of game i is seed + i
+ * @return Newly created environment or NULL on error
+ */
+ETRIS_ENV etris_env_create(int n, int width, int height, unsigned int seed);
+
+/** 
+ * Destroy batch environment and its games.
+ *
+ * @param env The environment
+ */
+void etris_env_destroy(ETRIS_ENV env);
+
+/** 
+ * Get number of actions of each game, 4 * width.
+ *
+ * @param env The environment
+ * @return Number of actions
+ */
+int etris_env_actions(ETRIS_ENV env);
+
+/** 
+ * Get size of the observation of one game, the observations of all games 
+ * follow each other. An observation is the occupancy of the field, one 
+ * byte per block row by row from the top, 1 if taken and 0 if not, then
+ * one-hot bytes of the current figure and of the next figure, 7 each. It
+ * is padded with zeros to a multiple of 16 bytes.
+ *
+ * @param env The environment
+ * @return Size in bytes
+ */
+size_t etris_env_observation_size(ETRIS_ENV env);
+
+/** 
+ * Write observations of all games, as of creation or the last step.
+ *
+ * @param env The environment
+ * @param observations Where to store n * etris_env_observation_size() bytes
+ */
+void etris_env_observe(ETRIS_ENV env, unsigned char *observations);
+
+/** 
+ * Write which actions of each game are valid, that is whose position is 
+ * free at the height of the figure. Reachability is not checked.
+ *
+ * @param env The environment
+ * @param masks Where to store n * etris_env_actions() bytes, 1 if valid
+ */
+void etris_env_masks(ETRIS_ENV env, unsigned char *masks);
+
+/** 
+ * Place the figure of every game as chosen by `actions', see etris_place().
+ * A game is done when it is over, when the next figure has no room or when
+ * its action is not valid. Games that are done are reset right away and 
+ * their observation is the start of the next game.
+ *
+ * @param env The environment
+ * @param actions Action of each game
+ * @param observations Where to store n * etris_env_observation_size() bytes
+ * @param rewards Where to store number of lines removed by each game
+ * @param dones Where to store 1 for each game that is done, 0 otherwise
+ */
+void etris_env_step(ETRIS_ENV env, const int *actions, unsigned char *observations, 
+		    float *rewards, unsigned char *dones);
+
+/** 
+ * Get instrumentation of an instance: calls and cells touched per internal
+ * routine and latency histograms of etris_tick(), etris_advance() ticks 
+ * and the input functions. Counting starts when the instance is created
+ * and is not affected by etris_reset() or etris_restore(). Only available
+ * if the library is built with ETRIS_STATS defined, otherwise nothing is
+ * counted or timed and the engine runs as fast as without. Timing reads 
+ * the monotonic clock twice per timed call, which is the main cost.
+ *
+ * @param e The etris instance
+ * @param stats Where to store the instrumentation
+ * @return ETRIS_OK or ETRIS_ERR if built without ETRIS_STATS
+ */
+int etris_stats(ETRIS e, struct etris_stats *stats);
+
+/** 
+ * Zero instrumentation of an instance, see etris_stats().
+ *
+ * @param e The etris instance
+ */
+void etris_stats_reset(ETRIS e);
+
+/** 
+ * Add instrumentation `stats' to `total', to aggregate instances.
+ *
+ * @param total Aggregate to add to
+ * @param stats Instrumentation to add
+ */
+void etris_stats_add(struct etris_stats *total, const struct etris_stats *stats);
+
+/** 
+ * Get instrumentation of all instances in pool, added up.
+ *
+ * @param p The pool
+ * @param total Where to store the sum
+ * @return ETRIS_OK or ETRIS_ERR if built without ETRIS_STATS
+ */
+int etris_pool_stats(ETRIS_POOL p, struct etris_stats *total);
+
+/** 
+ * Format instrumentation as text for logs and monitoring: one line per 
+ * routine with calls and cells, one line per entry point with calls and
+ * latency percentiles. Routines and entry points never used are left out.
+ * Built without ETRIS_STATS the text is empty, so that the library does 
+ * not depend on stdio.
+ *
+ * @param stats The instrumentation
+ * @param buf Where to store the text, or NULL to only get its length
+ * @param size Size of buf, text is truncated to fit like snprintf() does
+ * @return Length of the whole text, not counting the terminating zero
+ */
+int etris_stats_format(const struct etris_stats *stats, char *buf, size_t size);
+
 #ifdef __cplusplus
 }
 #endif